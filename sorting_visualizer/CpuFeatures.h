@@ -0,0 +1,63 @@
+#pragma once
+
+//which vector instructions the cpu running this has, so the hot loops can pick
+//their SIMD version at runtime and the same build still runs on older machines.
+//a function using them is marked SIMD_TARGET("ssse3") or SIMD_TARGET("avx2"), gcc
+//and clang only emit the instructions for functions that ask (msvc always does)
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define SIMD_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+#if defined(SIMD_X86) && (defined(__GNUC__) || defined(__clang__))
+#define SIMD_TARGET(isa) __attribute__((target(isa)))
+#else
+#define SIMD_TARGET(isa)
+#endif
+
+//the levels the SIMD loops come in, each needs everything below it
+enum SimdLevel {
+	SIMD_SCALAR,
+	SIMD_SSSE3,		//pshufb, 16 bytes at a time
+	SIMD_AVX2		//32 bytes at a time
+};
+
+inline const char* simdLevelName(SimdLevel level) {
+	switch (level) {
+	case SIMD_AVX2: return "avx2";
+	case SIMD_SSSE3: return "ssse3";
+	default: return "scalar";
+	}
+}
+
+inline SimdLevel detectSimdLevel() {
+#if defined(SIMD_X86) && defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 0);
+	int maxLeaf = info[0];
+	__cpuid(info, 1);
+	bool ssse3 = (info[2] & (1 << 9)) != 0;
+	//avx2 also needs the os to save the ymm registers
+	bool osAvx = (info[2] & (1 << 27)) && (info[2] & (1 << 28)) && (_xgetbv(0) & 6) == 6;
+	bool avx2 = false;
+	if (maxLeaf >= 7 && osAvx) {
+		__cpuidex(info, 7, 0);
+		avx2 = (info[1] & (1 << 5)) != 0;
+	}
+	return avx2 ? SIMD_AVX2 : ssse3 ? SIMD_SSSE3 : SIMD_SCALAR;
+#elif defined(SIMD_X86)
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2") ? SIMD_AVX2 : __builtin_cpu_supports("ssse3") ? SIMD_SSSE3 : SIMD_SCALAR;
+#else
+	return SIMD_SCALAR;
+#endif
+}
+
+//detected once, the first time it's asked for
+inline SimdLevel simdLevel() {
+	static const SimdLevel level = detectSimdLevel();
+	return level;
+}
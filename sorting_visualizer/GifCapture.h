@@ -0,0 +1,402 @@
+#pragma once
+
+#include <stdint.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "VideoCapture.h"
+
+//index 255 is never a color, it marks pixels that didn't change since the last frame
+#define GIF_TRANSPARENT 255
+#define GIF_COLORS 255
+//browsers slow anything under 2/100 s down to 1/10 s, so frames are dropped to stay at or above it
+#define GIF_MIN_DELAY 2
+
+//GIF LZW compression of one frame's indices (8 bit codes), written in 255 byte sub-blocks
+class GifLzw {
+public:
+
+	void Encode(const uint8_t* indices, size_t count, FILE* out) {
+		fputc(8, out); //minimum code size
+		blockSize = 0;
+		bitBuffer = 0;
+		bitCount = 0;
+		resetTable();
+		writeCode(CLEAR_CODE, out);
+
+		int prefix = indices[0];
+		for (size_t i = 1; i < count; i++) {
+			int symbol = indices[i];
+			int slot = findSlot(prefix, symbol);
+			if (keys[slot] != -1) {
+				prefix = codes[slot];
+				continue;
+			}
+			writeCode(prefix, out);
+			keys[slot] = (prefix << 8) | symbol;
+			codes[slot] = (uint16_t)nextCode;
+			if (nextCode == (1 << codeSize)) {
+				codeSize++;
+			}
+			//12 bit codes are the limit, start a new table
+			if (nextCode++ == 4095) {
+				writeCode(CLEAR_CODE, out);
+				resetTable();
+			}
+			prefix = symbol;
+		}
+		writeCode(prefix, out);
+		writeCode(END_CODE, out);
+		if (bitCount) {
+			writeByte((uint8_t)bitBuffer, out);
+		}
+		flushBlock(out);
+		fputc(0, out); //block terminator
+	}
+
+private:
+
+	enum { CLEAR_CODE = 256, END_CODE = 257, TABLE_SIZE = 8192 };
+
+	int keys[TABLE_SIZE]; //(prefix << 8) | symbol, -1 if empty
+	uint16_t codes[TABLE_SIZE];
+	int nextCode;
+	int codeSize;
+	uint32_t bitBuffer;
+	int bitCount;
+	uint8_t block[255];
+	int blockSize;
+
+	void resetTable() {
+		memset(keys, -1, sizeof(keys));
+		nextCode = END_CODE + 1;
+		codeSize = 9;
+	}
+
+	int findSlot(int prefix, int symbol) {
+		int key = (prefix << 8) | symbol;
+		int slot = (key * 2654435761u) >> 19 & (TABLE_SIZE - 1);
+		while (keys[slot] != -1 && keys[slot] != key) {
+			slot = (slot + 1) & (TABLE_SIZE - 1);
+		}
+		return slot;
+	}
+
+	void writeCode(int code, FILE* out) {
+		bitBuffer |= (uint32_t)code << bitCount;
+		bitCount += codeSize;
+		while (bitCount >= 8) {
+			writeByte((uint8_t)bitBuffer, out);
+			bitBuffer >>= 8;
+			bitCount -= 8;
+		}
+	}
+
+	void writeByte(uint8_t byte, FILE* out) {
+		block[blockSize++] = byte;
+		if (blockSize == 255) {
+			flushBlock(out);
+		}
+	}
+
+	void flushBlock(FILE* out) {
+		if (blockSize) {
+			fputc(blockSize, out);
+			fwrite(block, 1, blockSize, out);
+			blockSize = 0;
+		}
+	}
+};
+
+//animated gif written directly, without encoding an mp4 and converting it.
+//the sorts only move pixels around, so every frame has exactly the colors of the
+//first one: the palette is built once from it (median cut, exact if the image has
+//255 colors or fewer) along with a color -> index map, later frames only look up
+//the pixels whose color changed and store the rectangle around them, with the
+//unchanged pixels inside it transparent
+class GifCapture : public CaptureSink {
+public:
+
+	GifCapture(std::string fileName) {
+		gifFileName = fileName;
+		gifFile = NULL;
+		width = 0;
+		height = 0;
+		frameCounter = 0;
+		frameStride = 1;
+		fps = 0;
+		bufferBytes = 0;
+		lzw = NULL;
+	}
+
+	~GifCapture() {
+		Finish();
+	}
+
+	void Init(int frameWidth, int frameHeight, int fpsrate, int bitrate) {
+		width = frameWidth;
+		height = frameHeight;
+		fps = fpsrate;
+		frameStride = std::max(1, (fps * GIF_MIN_DELAY + 99) / 100);
+		if (!(gifFile = fopen(gifFileName.c_str(), "wb"))) {
+			logger->Debug("Failed to open " + gifFileName, 0);
+			return;
+		}
+		size_t pixels = (size_t)width * height;
+		bufferBytes = (long long)pixels * 6 + sizeof(GifLzw);
+		trackAlloc(MEM_FRAMES, bufferBytes);
+		lastFrame.resize(pixels * 3);
+		shown.resize(pixels);
+		current.resize(pixels);
+		rect.resize(pixels);
+		lzw = new GifLzw();
+	}
+
+	void AddFrame(uint8_t *data) {
+		if (!gifFile) {
+			return;
+		}
+		int frame = frameCounter++;
+		if (frame == 0) {
+			buildPalette(data);
+			writeHeader();
+		}
+		else if (frame % frameStride) {
+			return;
+		}
+
+		//only pixels whose color changed since the last written frame are looked up
+		int left = width, top = height, right = -1, bottom = -1;
+		for (int y = 0; y < height; y++) {
+			size_t row = (size_t)y * width;
+			if (frame > 0 && !memcmp(data + row * 3, &lastFrame[row * 3], (size_t)width * 3)) {
+				continue;
+			}
+			for (int x = 0; x < width; x++) {
+				size_t i = row + x;
+				if (frame > 0 && !memcmp(data + i * 3, &lastFrame[i * 3], 3)) {
+					continue;
+				}
+				uint8_t index = colorIndex(data + i * 3);
+				if (frame == 0 || index != current[i]) {
+					current[i] = index;
+					left = std::min(left, x);
+					right = std::max(right, x);
+					top = std::min(top, y);
+					bottom = y;
+				}
+			}
+			memcpy(&lastFrame[row * 3], data + row * 3, (size_t)width * 3);
+		}
+		if (right < 0) {
+			//nothing changed, a single transparent pixel keeps the timing
+			left = right = top = bottom = 0;
+		}
+
+		int rectWidth = right - left + 1, rectHeight = bottom - top + 1;
+		size_t n = 0;
+		for (int y = top; y <= bottom; y++) {
+			for (int x = left; x <= right; x++) {
+				size_t i = (size_t)y * width + x;
+				rect[n++] = (frame > 0 && current[i] == shown[i]) ? GIF_TRANSPARENT : current[i];
+				shown[i] = current[i];
+			}
+		}
+
+		//delay until the next shown frame, rounded so the total stays in step with fps
+		int delay = (int)((long long)(frame + frameStride) * 100 / fps - (long long)frame * 100 / fps);
+		uint8_t control[8] = { 0x21, 0xf9, 4, (1 << 2) | 1, (uint8_t)delay, (uint8_t)(delay >> 8), GIF_TRANSPARENT, 0 };
+		fwrite(control, 1, sizeof(control), gifFile);
+		uint8_t descriptor[10] = { 0x2c, (uint8_t)left, (uint8_t)(left >> 8), (uint8_t)top, (uint8_t)(top >> 8),
+			(uint8_t)rectWidth, (uint8_t)(rectWidth >> 8), (uint8_t)rectHeight, (uint8_t)(rectHeight >> 8), 0 };
+		fwrite(descriptor, 1, sizeof(descriptor), gifFile);
+		lzw->Encode(rect.data(), n, gifFile);
+	}
+
+	void Finish() {
+		if (gifFile) {
+			fputc(0x3b, gifFile); //trailer
+			fclose(gifFile);
+			gifFile = NULL;
+			trackFree(MEM_FRAMES, bufferBytes);
+		}
+		delete lzw;
+		lzw = NULL;
+	}
+
+private:
+
+	std::string gifFileName;
+	FILE *gifFile;
+	int width;
+	int height;
+	int fps;
+	int frameCounter;
+	int frameStride; //only every frameStride-th frame is written
+	long long bufferBytes;
+
+	uint8_t palette[256][3];
+	int paletteSize;
+	std::unordered_map<uint32_t, uint8_t> colorMap; //every color of the first frame -> palette index
+	std::vector<uint8_t> lastFrame; //rgb of the last written frame
+	std::vector<uint8_t> shown; //indices currently on screen
+	std::vector<uint8_t> current;
+	std::vector<uint8_t> rect;
+	GifLzw* lzw;
+
+	struct ColorBox {
+		size_t begin, end; //range of the distinct colors
+		size_t pixels; //pixels of those colors
+		int low[3], high[3]; //per channel
+	};
+
+	//the pixel count and channel ranges of box
+	void measureBox(ColorBox* box, const std::vector<uint32_t>& colors, const std::vector<size_t>& counts) {
+		box->pixels = 0;
+		for (int c = 0; c < 3; c++) {
+			box->low[c] = 255;
+			box->high[c] = 0;
+		}
+		for (size_t i = box->begin; i < box->end; i++) {
+			box->pixels += counts[i];
+			for (int c = 0; c < 3; c++) {
+				int v = colors[i] >> (16 - c * 8) & 0xff;
+				box->low[c] = std::min(box->low[c], v);
+				box->high[c] = std::max(box->high[c], v);
+			}
+		}
+	}
+
+	//median cut over the distinct colors of the first frame, each weighted by its
+	//pixels, so 255 colors or fewer get an exact palette
+	void buildPalette(const uint8_t* data) {
+		size_t pixels = (size_t)width * height;
+		std::vector<uint32_t> all(pixels);
+		for (size_t i = 0; i < pixels; i++) {
+			all[i] = data[i * 3] << 16 | data[i * 3 + 1] << 8 | data[i * 3 + 2];
+		}
+		std::sort(all.begin(), all.end());
+		std::vector<uint32_t> colors;
+		std::vector<size_t> counts;
+		for (size_t i = 0; i < pixels; i++) {
+			if (colors.empty() || colors.back() != all[i]) {
+				colors.push_back(all[i]);
+				counts.push_back(0);
+			}
+			counts.back()++;
+		}
+		std::vector<uint32_t>().swap(all);
+
+		std::vector<ColorBox> boxes;
+		ColorBox first;
+		first.begin = 0;
+		first.end = colors.size();
+		measureBox(&first, colors, counts);
+		boxes.push_back(first);
+		std::vector<std::pair<uint32_t, size_t> > sorted;
+		while (boxes.size() < GIF_COLORS) {
+			//split the box with the widest channel (none if every box is one color), at the median pixel
+			int best = -1, bestRange = 0, bestChannel = 0;
+			for (size_t b = 0; b < boxes.size(); b++) {
+				for (int c = 0; c < 3; c++) {
+					if (boxes[b].high[c] - boxes[b].low[c] > bestRange) {
+						best = (int)b;
+						bestRange = boxes[b].high[c] - boxes[b].low[c];
+						bestChannel = c;
+					}
+				}
+			}
+			if (best < 0) {
+				break;
+			}
+			ColorBox box = boxes[best];
+			int shift = 16 - bestChannel * 8;
+			sorted.clear();
+			for (size_t i = box.begin; i < box.end; i++) {
+				sorted.push_back(std::make_pair(colors[i], counts[i]));
+			}
+			std::sort(sorted.begin(), sorted.end(), [shift](const std::pair<uint32_t, size_t>& a, const std::pair<uint32_t, size_t>& b) {
+				return (a.first >> shift & 0xff) < (b.first >> shift & 0xff);
+			});
+			for (size_t i = 0; i < sorted.size(); i++) {
+				colors[box.begin + i] = sorted[i].first;
+				counts[box.begin + i] = sorted[i].second;
+			}
+			//the color the middle pixel has
+			size_t median = box.begin, below = 0;
+			while (below + counts[median] <= box.pixels / 2) {
+				below += counts[median++];
+			}
+			//keep equal values on one side so a box never ends up empty
+			uint32_t value = colors[median] >> shift & 0xff;
+			while (median > box.begin && (colors[median - 1] >> shift & 0xff) == value) {
+				median--;
+			}
+			if (median == box.begin) {
+				while (median < box.end && (colors[median] >> shift & 0xff) == value) {
+					median++;
+				}
+			}
+			ColorBox upper;
+			upper.begin = median;
+			upper.end = box.end;
+			measureBox(&upper, colors, counts);
+			boxes[best].end = median;
+			measureBox(&boxes[best], colors, counts);
+			boxes.push_back(upper);
+		}
+
+		paletteSize = (int)boxes.size();
+		memset(palette, 0, sizeof(palette));
+		for (int b = 0; b < paletteSize; b++) {
+			unsigned long long sum[3] = { 0, 0, 0 };
+			for (size_t i = boxes[b].begin; i < boxes[b].end; i++) {
+				sum[0] += (unsigned long long)(colors[i] >> 16 & 0xff) * counts[i];
+				sum[1] += (unsigned long long)(colors[i] >> 8 & 0xff) * counts[i];
+				sum[2] += (unsigned long long)(colors[i] & 0xff) * counts[i];
+			}
+			size_t count = boxes[b].pixels;
+			for (int c = 0; c < 3; c++) {
+				palette[b][c] = (uint8_t)((sum[c] + count / 2) / count);
+			}
+			for (size_t i = boxes[b].begin; i < boxes[b].end; i++) {
+				colorMap[colors[i]] = (uint8_t)b;
+			}
+		}
+	}
+
+	uint8_t colorIndex(const uint8_t* rgb) {
+		uint32_t color = rgb[0] << 16 | rgb[1] << 8 | rgb[2];
+		std::unordered_map<uint32_t, uint8_t>::iterator found = colorMap.find(color);
+		if (found != colorMap.end()) {
+			return found->second;
+		}
+		//not in the first frame, can't happen unless a sort loses pixels
+		int best = 0, bestDistance = 1 << 30;
+		for (int p = 0; p < paletteSize; p++) {
+			int dr = palette[p][0] - rgb[0], dg = palette[p][1] - rgb[1], db = palette[p][2] - rgb[2];
+			int distance = dr * dr + dg * dg + db * db;
+			if (distance < bestDistance) {
+				best = p;
+				bestDistance = distance;
+			}
+		}
+		colorMap[color] = (uint8_t)best;
+		return (uint8_t)best;
+	}
+
+	void writeHeader() {
+		fwrite("GIF89a", 1, 6, gifFile);
+		uint8_t screen[7] = { (uint8_t)width, (uint8_t)(width >> 8), (uint8_t)height, (uint8_t)(height >> 8), 0xf7, 0, 0 };
+		fwrite(screen, 1, sizeof(screen), gifFile);
+		fwrite(palette, 1, sizeof(palette), gifFile);
+		//loop forever
+		uint8_t loop[19] = { 0x21, 0xff, 11, 'N', 'E', 'T', 'S', 'C', 'A', 'P', 'E', '2', '.', '0', 3, 1, 0, 0, 0 };
+		fwrite(loop, 1, sizeof(loop), gifFile);
+	}
+};
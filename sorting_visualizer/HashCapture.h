@@ -0,0 +1,144 @@
+#pragma once
+
+#include <stdint.h>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#include "VideoCapture.h"
+
+//XXH64 (xxHash, 64 bit variant), used to fingerprint frames
+#define XXH_PRIME64_1 11400714785074694791ULL
+#define XXH_PRIME64_2 14029467366897019727ULL
+#define XXH_PRIME64_3 1609587929392839161ULL
+#define XXH_PRIME64_4 9650029242287828579ULL
+#define XXH_PRIME64_5 2870177450012600261ULL
+
+inline uint64_t xxhRotl(uint64_t x, int r) {
+	return (x << r) | (x >> (64 - r));
+}
+
+inline uint64_t xxhRead64(const uint8_t* p) {
+	uint64_t v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+inline uint32_t xxhRead32(const uint8_t* p) {
+	uint32_t v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+inline uint64_t xxhRound(uint64_t acc, uint64_t input) {
+	acc += input * XXH_PRIME64_2;
+	acc = xxhRotl(acc, 31);
+	return acc * XXH_PRIME64_1;
+}
+
+inline uint64_t xxhMergeRound(uint64_t acc, uint64_t val) {
+	acc ^= xxhRound(0, val);
+	return acc * XXH_PRIME64_1 + XXH_PRIME64_4;
+}
+
+inline uint64_t xxHash64(const uint8_t* p, size_t len, uint64_t seed) {
+	const uint8_t* end = p + len;
+	uint64_t h;
+
+	if (len >= 32) {
+		uint64_t v1 = seed + XXH_PRIME64_1 + XXH_PRIME64_2;
+		uint64_t v2 = seed + XXH_PRIME64_2;
+		uint64_t v3 = seed;
+		uint64_t v4 = seed - XXH_PRIME64_1;
+		const uint8_t* limit = end - 32;
+		do {
+			v1 = xxhRound(v1, xxhRead64(p));
+			v2 = xxhRound(v2, xxhRead64(p + 8));
+			v3 = xxhRound(v3, xxhRead64(p + 16));
+			v4 = xxhRound(v4, xxhRead64(p + 24));
+			p += 32;
+		} while (p <= limit);
+		h = xxhRotl(v1, 1) + xxhRotl(v2, 7) + xxhRotl(v3, 12) + xxhRotl(v4, 18);
+		h = xxhMergeRound(h, v1);
+		h = xxhMergeRound(h, v2);
+		h = xxhMergeRound(h, v3);
+		h = xxhMergeRound(h, v4);
+	}
+	else {
+		h = seed + XXH_PRIME64_5;
+	}
+	h += (uint64_t)len;
+
+	while (p + 8 <= end) {
+		h ^= xxhRound(0, xxhRead64(p));
+		h = xxhRotl(h, 27) * XXH_PRIME64_1 + XXH_PRIME64_4;
+		p += 8;
+	}
+	if (p + 4 <= end) {
+		h ^= (uint64_t)xxhRead32(p) * XXH_PRIME64_1;
+		h = xxhRotl(h, 23) * XXH_PRIME64_2 + XXH_PRIME64_3;
+		p += 4;
+	}
+	while (p < end) {
+		h ^= (*p) * XXH_PRIME64_5;
+		h = xxhRotl(h, 11) * XXH_PRIME64_1;
+		p++;
+	}
+
+	h ^= h >> 33;
+	h *= XXH_PRIME64_2;
+	h ^= h >> 29;
+	h *= XXH_PRIME64_3;
+	h ^= h >> 32;
+	return h;
+}
+
+//"dry render": instead of converting and encoding, every frame is hashed and
+//the hash written to a text file (one "frame hash" line each), so two builds
+//can be diffed to prove they produce exactly the same video
+class HashCapture : public CaptureSink {
+public:
+
+	HashCapture(std::string fileName) {
+		hashFileName = fileName;
+		hashFile = NULL;
+		frameBytes = 0;
+		frameCounter = 0;
+	}
+
+	~HashCapture() {
+		if (hashFile) {
+			fclose(hashFile);
+		}
+	}
+
+	void Init(int width, int height, int fpsrate, int bitrate) {
+		frameBytes = (size_t)width * height * 3;
+		if (!(hashFile = fopen(hashFileName.c_str(), "w"))) {
+			logger->Debug("Failed to open hash file", 0);
+			return;
+		}
+		fprintf(hashFile, "# %d x %d rgb24, xxh64\n", width, height);
+	}
+
+	void AddFrame(uint8_t *data) {
+		if (!hashFile) {
+			return;
+		}
+		fprintf(hashFile, "%d %016llx\n", frameCounter++, (unsigned long long)xxHash64(data, frameBytes, 0));
+	}
+
+	void Finish() {
+		if (hashFile) {
+			fclose(hashFile);
+			hashFile = NULL;
+		}
+	}
+
+private:
+
+	std::string hashFileName;
+	FILE *hashFile;
+	size_t frameBytes;
+	int frameCounter;
+};
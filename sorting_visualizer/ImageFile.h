@@ -0,0 +1,340 @@
+#pragma once
+
+#include <stdint.h>
+#include <algorithm>
+#include <cctype>
+#include <climits>
+#include <cstdlib>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+#include "MappedFile.h"
+#include "MemoryStats.h"
+
+//reads the uncompressed images (ppm, pgm, pam and bmp) without stb_image decoding
+//all of it into a buffer of its own first. an 8 bit rgb ppm or pam already is the rgb
+//the sorts work on, so its pixels are used right where they are in the mapped file
+//(copy on write, so sorting them never changes the file). anything else is converted
+//a row at a time from the mapped file into the rgb buffer, so the one copy of the
+//image in memory is the one that gets sorted. the conversions are the same stb_image
+//does when it's asked for rgb: gray is spread over the three channels, alpha is
+//dropped and 16 bit samples are scaled down to 8. for a mapped render (mapDir) the
+//rows are converted into a mapped file there instead, so the image is never in RAM
+class ImageFile {
+public:
+
+	ImageFile() {
+		rgb = NULL;
+		owned = false;
+		width = 0;
+		height = 0;
+	}
+
+	~ImageFile() {
+		Close();
+	}
+
+	//false if fileName isn't an image this reads, or is cut short (stb_image can try it then),
+	//throws if it can't be converted into mapDir
+	bool Open(const std::string& fileName, const std::string& mapDir = "") {
+		Close();
+		if (!file.Map(fileName) || !parse()) {
+			file.Close();
+			return false;
+		}
+		if (format.channels == 3 && format.maxval == 255 && format.pixelBytes == 3 && !format.bgr) {
+			rgb = file.Data() + format.offset;
+			file.Advise(MAP_ADVICE_WILLNEED, format.offset, (size_t)width * height * 3);
+			return true;
+		}
+
+		long long bytes = (long long)width * height * 3;
+		if (!mapDir.empty()) {
+			if (!converted.Open(mapDir, "image", (size_t)bytes)) {
+				file.Close();
+				throw std::runtime_error("couldn't map the image in " + mapDir);
+			}
+			converted.Advise(MAP_ADVICE_SEQUENTIAL);
+			rgb = converted.Data();
+		}
+		else {
+			trackAlloc(MEM_IMAGE, bytes);
+			rgb = new uint8_t[(size_t)bytes];
+			owned = true;
+		}
+		file.Advise(MAP_ADVICE_SEQUENTIAL);
+		convertRows();
+		file.Close();
+		return true;
+	}
+
+	//just the size of fileName, false if it isn't an image this reads
+	static bool Info(const std::string& fileName, int* imageWidth, int* imageHeight) {
+		ImageFile image;
+		if (!image.file.Map(fileName) || !image.parse()) {
+			return false;
+		}
+		*imageWidth = image.width;
+		*imageHeight = image.height;
+		return true;
+	}
+
+	void Close() {
+		if (owned) {
+			delete[] rgb;
+			trackFree(MEM_IMAGE, (long long)width * height * 3);
+		}
+		file.Close();
+		converted.Close();
+		rgb = NULL;
+		owned = false;
+		conversion = "";
+	}
+
+	uint8_t* RGB() const {
+		return rgb;
+	}
+
+	int Width() const {
+		return width;
+	}
+
+	int Height() const {
+		return height;
+	}
+
+	//whether the pixels are the mapped file's, or a converted copy
+	bool ZeroCopy() const {
+		return rgb && !owned && !converted.Data();
+	}
+
+	//the mapped file the pixels are in (the image's own, or the one they were converted
+	//into), NULL if they're in memory of their own
+	MappedFile* Mapping() {
+		if (ZeroCopy()) {
+			return &file;
+		}
+		return converted.Data() ? &converted : NULL;
+	}
+
+	//what was lost turning the file into 8 bit rgb, empty if nothing
+	const std::string& Conversion() const {
+		return conversion;
+	}
+
+private:
+
+	//where the pixels are in the file and how they're stored
+	struct Format {
+		size_t offset;
+		int channels;		//1 gray, 2 gray and alpha, 3 rgb, 4 rgb and alpha
+		unsigned int maxval;	//over 255 the samples are 16 bit big endian
+		int pixelBytes;
+		bool bgr;			//bmp, rows of bgr(x) padded to 4 bytes
+		bool bottomUp;		//bmp, the last row comes first
+		size_t rowBytes;
+	};
+
+	MappedFile file;
+	MappedFile converted;	//what the rows were converted into, for a mapped render
+	Format format;
+	uint8_t* rgb;
+	bool owned;
+	int width;
+	int height;
+	std::string conversion;
+
+	bool parse() {
+		if (file.Size() < 2) {
+			return false;
+		}
+		const char* magic = (const char*)file.Data();
+		bool ok;
+		if (magic[0] == 'P' && (magic[1] == '5' || magic[1] == '6')) {
+			ok = parsePNM();
+		}
+		else if (magic[0] == 'P' && magic[1] == '7') {
+			ok = parsePAM();
+		}
+		else if (magic[0] == 'B' && magic[1] == 'M') {
+			ok = parseBMP();
+		}
+		else {
+			return false;
+		}
+		if (!ok || width <= 0 || height <= 0 || (unsigned long long)width * height * 3 > (size_t)-1) {
+			return false;
+		}
+		//every row has to be there
+		if (format.offset > file.Size() || (unsigned long long)format.rowBytes * height > file.Size() - format.offset) {
+			return false;
+		}
+		if (format.maxval > 255) {
+			conversion = "16 bit samples reduced to 8 bits";
+		}
+		if (format.channels == 2 || format.channels == 4) {
+			conversion += std::string(conversion.empty() ? "" : ", ") + "alpha channel dropped";
+		}
+		return true;
+	}
+
+	bool setSize(unsigned long long imageWidth, unsigned long long imageHeight) {
+		if (imageWidth == 0 || imageHeight == 0 || imageWidth > INT_MAX || imageHeight > INT_MAX) {
+			return false;
+		}
+		width = (int)imageWidth;
+		height = (int)imageHeight;
+		return true;
+	}
+
+	//the next number of a ppm or pgm header, past whitespace and comments
+	bool pnmNumber(size_t* at, unsigned long long* value) {
+		const uint8_t* data = file.Data();
+		while (*at < file.Size() && (isspace(data[*at]) || data[*at] == '#')) {
+			if (data[*at] == '#') {
+				while (*at < file.Size() && data[*at] != '\n') {
+					(*at)++;
+				}
+			}
+			else {
+				(*at)++;
+			}
+		}
+		if (*at >= file.Size() || !isdigit(data[*at])) {
+			return false;
+		}
+		*value = 0;
+		while (*at < file.Size() && isdigit(data[*at]) && *value <= UINT_MAX) {
+			*value = *value * 10 + (data[(*at)++] - '0');
+		}
+		return *value <= UINT_MAX;
+	}
+
+	//P6 (rgb) or P5 (gray): the size and maxval, then one whitespace and the samples
+	bool parsePNM() {
+		size_t at = 2;
+		unsigned long long imageWidth, imageHeight, maxval;
+		if (!pnmNumber(&at, &imageWidth) || !pnmNumber(&at, &imageHeight) || !pnmNumber(&at, &maxval)) {
+			return false;
+		}
+		if (at >= file.Size() || !isspace(file.Data()[at]) || maxval == 0 || maxval > 65535 || !setSize(imageWidth, imageHeight)) {
+			return false;
+		}
+		format.offset = at + 1;
+		format.channels = file.Data()[1] == '6' ? 3 : 1;
+		format.maxval = (unsigned int)maxval;
+		format.bgr = false;
+		format.bottomUp = false;
+		format.pixelBytes = format.channels * (maxval > 255 ? 2 : 1);
+		format.rowBytes = (size_t)width * format.pixelBytes;
+		return true;
+	}
+
+	//P7: KEY value lines up to ENDHDR, then the samples
+	bool parsePAM() {
+		const char* data = (const char*)file.Data();
+		size_t at = 2;
+		unsigned long long imageWidth = 0, imageHeight = 0, depth = 0, maxval = 0;
+		while (true) {
+			size_t end = at;
+			while (end < file.Size() && data[end] != '\n') {
+				end++;
+			}
+			if (end >= file.Size()) {
+				return false;
+			}
+			std::stringstream line(std::string(data + at, end - at));
+			at = end + 1;
+			std::string key;
+			line >> key;
+			if (key == "ENDHDR") {
+				break;
+			}
+			if (key == "WIDTH") {
+				line >> imageWidth;
+			}
+			else if (key == "HEIGHT") {
+				line >> imageHeight;
+			}
+			else if (key == "DEPTH") {
+				line >> depth;
+			}
+			else if (key == "MAXVAL") {
+				line >> maxval;
+			}
+			//TUPLTYPE and comments, the depth says all that's needed
+		}
+		if (depth < 1 || depth > 4 || maxval == 0 || maxval > 65535 || !setSize(imageWidth, imageHeight)) {
+			return false;
+		}
+		format.offset = at;
+		format.channels = (int)depth;
+		format.maxval = (unsigned int)maxval;
+		format.bgr = false;
+		format.bottomUp = false;
+		format.pixelBytes = format.channels * (maxval > 255 ? 2 : 1);
+		format.rowBytes = (size_t)width * format.pixelBytes;
+		return true;
+	}
+
+	static unsigned int littleEndian(const uint8_t* bytes, int count) {
+		unsigned int value = 0;
+		for (int i = count - 1; i >= 0; i--) {
+			value = value << 8 | bytes[i];
+		}
+		return value;
+	}
+
+	//uncompressed 24 and 32 bit bmps, the palette and compressed ones are left to stb_image
+	bool parseBMP() {
+		const uint8_t* data = file.Data();
+		if (file.Size() < 54 || littleEndian(data + 14, 4) < 40) {
+			return false;
+		}
+		int imageWidth = (int)littleEndian(data + 18, 4);
+		int imageHeight = (int)littleEndian(data + 22, 4);
+		int bits = (int)littleEndian(data + 28, 2);
+		if ((bits != 24 && bits != 32) || littleEndian(data + 30, 4) != 0 || imageWidth <= 0 || imageHeight == 0 || imageHeight == INT_MIN) {
+			return false;
+		}
+		if (!setSize(imageWidth, std::abs(imageHeight))) {
+			return false;
+		}
+		format.offset = littleEndian(data + 10, 4);
+		//the fourth byte of a 32 bit bmp without bitfields isn't alpha
+		format.channels = 3;
+		format.maxval = 255;
+		format.pixelBytes = bits / 8;
+		format.bgr = true;
+		format.bottomUp = imageHeight > 0;
+		format.rowBytes = ((size_t)width * bits + 31) / 32 * 4;
+		return true;
+	}
+
+	//the file's rows into rgb, read front to back
+	void convertRows() {
+		int sampleBytes = format.maxval > 255 ? 2 : 1;
+		for (int fileRow = 0; fileRow < height; fileRow++) {
+			const uint8_t* source = file.Data() + format.offset + (size_t)fileRow * format.rowBytes;
+			uint8_t* row = rgb + (size_t)(format.bottomUp ? height - 1 - fileRow : fileRow) * width * 3;
+			for (int x = 0; x < width; x++) {
+				const uint8_t* pixel = source + (size_t)x * format.pixelBytes;
+				if (format.bgr) {
+					row[x * 3] = pixel[2];
+					row[x * 3 + 1] = pixel[1];
+					row[x * 3 + 2] = pixel[0];
+					continue;
+				}
+				for (int k = 0; k < 3; k++) {
+					const uint8_t* sample = pixel + (format.channels < 3 ? 0 : k) * sampleBytes;
+					unsigned int value = sampleBytes == 2 ? (sample[0] << 8 | sample[1]) : sample[0];
+					if (format.maxval != 255) {
+						value = (std::min(value, format.maxval) * 255 + format.maxval / 2) / format.maxval;
+					}
+					row[x * 3 + k] = (uint8_t)value;
+				}
+			}
+		}
+	}
+};
@@ -0,0 +1,192 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+extern "C"
+{
+#include <libavutil/error.h>
+#include <libavutil/log.h>
+}
+
+typedef void(*FuncPtr)(const char *);
+
+#define LOG_RING_SLOTS 1024
+#define LOG_FLUSH_MS 200
+
+//buffered log file: callers copy the line into a ring of reusable strings and a
+//background thread writes the ring out, so logging never waits on the disk.
+//lines above the level (AV_LOG_* values) are dropped before they are formatted,
+//and if the ring fills up lines are dropped and counted instead of blocking
+class Logger {
+public:
+
+	Logger(std::string fileName = "Logs.txt", int logLevel = AV_LOG_INFO) {
+		logFileName = fileName;
+		level = logLevel;
+		extDebug = NULL;
+		logFile = NULL;
+		slots.resize(LOG_RING_SLOTS);
+		spare.resize(LOG_RING_SLOTS);
+		head = 0;
+		count = 0;
+		dropped = 0;
+		stopping = false;
+		flusher = std::thread(&Logger::flushLoop, this);
+	}
+
+	~Logger() {
+		{
+			std::lock_guard<std::mutex> lock(ringMutex);
+			stopping = true;
+		}
+		wake.notify_one();
+		flusher.join();
+		if (logFile) {
+			fclose(logFile);
+		}
+	}
+
+	//check before formatting a line
+	bool Enabled(int lineLevel) const {
+		return lineLevel <= level;
+	}
+
+	void SetLevel(int logLevel) {
+		level = logLevel;
+	}
+
+	void Log(const char* str) {
+		std::unique_lock<std::mutex> lock(ringMutex);
+		if (count == slots.size()) {
+			dropped++;
+			return;
+		}
+		slots[(head + count) % slots.size()].assign(str);
+		count++;
+		if (count >= slots.size() / 2) {
+			lock.unlock();
+			wake.notify_one();
+		}
+	}
+
+	void Log(const std::string& str) {
+		Log(str.c_str());
+	}
+
+	void Debug(std::string str, int err) {
+		if (err < 0) {
+			char errbuf[64];
+			av_strerror(err, errbuf, sizeof(errbuf));
+			str += std::string(": ") + errbuf;
+		}
+		else if (err > 0) {
+			str += " " + std::to_string(err);
+		}
+		if (Enabled(AV_LOG_ERROR)) {
+			Log(str + "\n");
+		}
+		if (extDebug) {
+			extDebug(str.c_str());
+		}
+	}
+
+	void SetDebug(FuncPtr fp) {
+		extDebug = fp;
+	}
+
+	//write out everything logged so far before returning
+	void Flush() {
+		std::lock_guard<std::mutex> writeLock(writeMutex);
+		drain();
+	}
+
+private:
+
+	std::string logFileName;
+	std::atomic<int> level;
+	FuncPtr extDebug;
+	FILE* logFile;	//opened on the first line, so quiet runs leave no file
+
+	std::vector<std::string> slots;
+	std::vector<std::string> spare;	//only touched by whoever holds writeMutex
+	size_t head;
+	size_t count;
+	unsigned long long dropped;
+	bool stopping;
+	std::mutex ringMutex;
+	std::mutex writeMutex;
+	std::condition_variable wake;
+	std::thread flusher;
+
+	void flushLoop() {
+		std::unique_lock<std::mutex> lock(ringMutex);
+		while (!stopping) {
+			wake.wait_for(lock, std::chrono::milliseconds(LOG_FLUSH_MS));
+			lock.unlock();
+			Flush();
+			lock.lock();
+		}
+		lock.unlock();
+		Flush();
+	}
+
+	//swaps the filled slots with the spare ones (so both keep their buffers) and writes them
+	void drain() {
+		size_t lines;
+		unsigned long long lost;
+		{
+			std::lock_guard<std::mutex> lock(ringMutex);
+			lines = count;
+			for (size_t i = 0; i < lines; i++) {
+				spare[i].swap(slots[(head + i) % slots.size()]);
+			}
+			head = (head + lines) % slots.size();
+			count = 0;
+			lost = dropped;
+			dropped = 0;
+		}
+		if (!lines && !lost) {
+			return;
+		}
+		if (!logFile && !(logFile = fopen(logFileName.c_str(), "a"))) {
+			return;
+		}
+		for (size_t i = 0; i < lines; i++) {
+			fwrite(spare[i].data(), 1, spare[i].size(), logFile);
+			spare[i].clear();
+		}
+		if (lost) {
+			fprintf(logFile, "[logger] dropped %llu lines, the log ring was full\n", lost);
+		}
+		fflush(logFile);
+	}
+
+	Logger(const Logger&);
+	Logger& operator=(const Logger&);
+};
+
+//Logs.txt, used by anything that wasn't given its own logger
+inline Logger& defaultLogger() {
+	static Logger logger;
+	return logger;
+}
+
+//AV_LOG_* level for quiet, error, warning, info, verbose or debug, -1 if it's none of them
+inline int logLevelFromName(const std::string& name) {
+	static const char* names[] = { "quiet", "error", "warning", "info", "verbose", "debug" };
+	static const int levels[] = { AV_LOG_QUIET, AV_LOG_ERROR, AV_LOG_WARNING, AV_LOG_INFO, AV_LOG_VERBOSE, AV_LOG_DEBUG };
+	for (int i = 0; i < 6; i++) {
+		if (name == names[i]) {
+			return levels[i];
+		}
+	}
+	return -1;
+}
@@ -0,0 +1,237 @@
+#pragma once
+
+#include <stdint.h>
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <string>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "MemoryStats.h"
+
+//how a mapped range is about to be used, passed on to madvise (the hints are
+//ignored on windows, where the cache manager does its own read ahead)
+enum MapAdvice {
+	MAP_ADVICE_NORMAL,
+	MAP_ADVICE_SEQUENTIAL,	//read or written front to back, read ahead and drop behind
+	MAP_ADVICE_RANDOM,		//no read ahead
+	MAP_ADVICE_WILLNEED,	//start reading it in now
+	MAP_ADVICE_DONTNEED		//done with it for now, the pages can go
+};
+
+//a temporary file of a fixed size mapped into memory, for arrays bigger than the
+//RAM. the file is created new in dir and removed again when it's closed (right
+//away on posix, where the mapping keeps it alive), so nothing is left behind
+//after a crash. or an existing file, mapped to be read. its pages are only
+//counted as mapped, not against the budget
+class MappedFile {
+public:
+
+	MappedFile() {
+		data = NULL;
+		bytes = 0;
+#ifdef _WIN32
+		file = INVALID_HANDLE_VALUE;
+		mapping = NULL;
+#endif
+	}
+
+	~MappedFile() {
+		Close();
+	}
+
+	//a new file of size bytes in dir (named after what it holds), false if it
+	//couldn't be made, e.g. the disk is full
+	bool Open(const std::string& dir, const std::string& name, size_t size) {
+		Close();
+		if (size == 0) {
+			return false;
+		}
+		static std::atomic<unsigned int> counter(0);
+		//another render (or process) may be mapping in the same dir, the next name is tried then
+		int result = MAP_CREATE_EXISTS;
+		for (int attempt = 0; attempt < 100 && result == MAP_CREATE_EXISTS; attempt++) {
+			std::string fileName = dir + "/" + name + "_" + std::to_string(processId()) + "_" + std::to_string(counter++) + ".map";
+			result = create(fileName, size);
+		}
+		if (result != MAP_CREATE_OK) {
+			return false;
+		}
+		bytes = size;
+		trackMapped(bytes);
+		return true;
+	}
+
+	//all of the existing fileName, copy on write: the mapping can be written to, but
+	//that only changes the memory, never the file. false if it can't be read or is empty
+	bool Map(const std::string& fileName) {
+		Close();
+#ifdef _WIN32
+		file = CreateFileA(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+		LARGE_INTEGER fileSize;
+		if (file == INVALID_HANDLE_VALUE || !GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0 || (unsigned long long)fileSize.QuadPart > (size_t)-1) {
+			if (file != INVALID_HANDLE_VALUE) {
+				CloseHandle(file);
+			}
+			file = INVALID_HANDLE_VALUE;
+			return false;
+		}
+		mapping = CreateFileMappingA(file, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+		if (mapping) {
+			data = (uint8_t*)MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0);
+		}
+		if (!data) {
+			if (mapping) {
+				CloseHandle(mapping);
+			}
+			CloseHandle(file);
+			mapping = NULL;
+			file = INVALID_HANDLE_VALUE;
+			return false;
+		}
+		bytes = (size_t)fileSize.QuadPart;
+#else
+		int fd = open(fileName.c_str(), O_RDONLY);
+		if (fd < 0) {
+			return false;
+		}
+		struct stat info;
+		void* mapped = MAP_FAILED;
+		if (fstat(fd, &info) == 0 && info.st_size > 0 && (unsigned long long)info.st_size <= (size_t)-1) {
+			mapped = mmap(NULL, (size_t)info.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+		}
+		close(fd);
+		if (mapped == MAP_FAILED) {
+			return false;
+		}
+		data = (uint8_t*)mapped;
+		bytes = (size_t)info.st_size;
+#endif
+		trackMapped(bytes);
+		return true;
+	}
+
+	void Close() {
+		if (!data) {
+			return;
+		}
+#ifdef _WIN32
+		UnmapViewOfFile(data);
+		CloseHandle(mapping);
+		CloseHandle(file);
+		mapping = NULL;
+		file = INVALID_HANDLE_VALUE;
+#else
+		munmap(data, bytes);
+#endif
+		untrackMapped(bytes);
+		data = NULL;
+		bytes = 0;
+	}
+
+	uint8_t* Data() const {
+		return data;
+	}
+
+	size_t Size() const {
+		return bytes;
+	}
+
+	//hint for offset .. offset + length, rounded out to whole pages
+	void Advise(MapAdvice advice, size_t offset, size_t length) {
+#ifndef _WIN32
+		if (!data || offset >= bytes) {
+			return;
+		}
+		size_t page = (size_t)sysconf(_SC_PAGESIZE);
+		size_t start = offset / page * page;
+		size_t end = std::min(bytes, offset + length);
+		int flag = MADV_NORMAL;
+		switch (advice) {
+		case MAP_ADVICE_SEQUENTIAL: flag = MADV_SEQUENTIAL; break;
+		case MAP_ADVICE_RANDOM: flag = MADV_RANDOM; break;
+		case MAP_ADVICE_WILLNEED: flag = MADV_WILLNEED; break;
+		case MAP_ADVICE_DONTNEED: flag = MADV_DONTNEED; break;
+		default: break;
+		}
+		madvise(data + start, end - start, flag);
+#endif
+	}
+
+	void Advise(MapAdvice advice) {
+		Advise(advice, 0, bytes);
+	}
+
+private:
+
+	enum { MAP_CREATE_OK, MAP_CREATE_EXISTS, MAP_CREATE_FAILED };
+
+	uint8_t* data;
+	size_t bytes;
+#ifdef _WIN32
+	HANDLE file;
+	HANDLE mapping;
+#endif
+
+	static unsigned long processId() {
+#ifdef _WIN32
+		return (unsigned long)GetCurrentProcessId();
+#else
+		return (unsigned long)getpid();
+#endif
+	}
+
+	//creates fileName (never an existing one) at size bytes and maps all of it
+	int create(const std::string& fileName, size_t size) {
+#ifdef _WIN32
+		file = CreateFileA(fileName.c_str(), GENERIC_READ | GENERIC_WRITE, 0, NULL, CREATE_NEW,
+			FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE, NULL);
+		if (file == INVALID_HANDLE_VALUE) {
+			return GetLastError() == ERROR_FILE_EXISTS ? MAP_CREATE_EXISTS : MAP_CREATE_FAILED;
+		}
+		mapping = CreateFileMappingA(file, NULL, PAGE_READWRITE, (DWORD)((unsigned long long)size >> 32), (DWORD)(size & 0xFFFFFFFF), NULL);
+		if (mapping) {
+			data = (uint8_t*)MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, size);
+		}
+		if (!data) {
+			if (mapping) {
+				CloseHandle(mapping);
+			}
+			CloseHandle(file);
+			mapping = NULL;
+			file = INVALID_HANDLE_VALUE;
+			return MAP_CREATE_FAILED;
+		}
+		return MAP_CREATE_OK;
+#else
+		int fd = open(fileName.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+		if (fd < 0) {
+			return errno == EEXIST ? MAP_CREATE_EXISTS : MAP_CREATE_FAILED;
+		}
+		//the mapping keeps the file alive, the name isn't needed anymore
+		unlink(fileName.c_str());
+		void* mapped = MAP_FAILED;
+		if (ftruncate(fd, (off_t)size) == 0) {
+			mapped = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		}
+		close(fd);
+		if (mapped == MAP_FAILED) {
+			return MAP_CREATE_FAILED;
+		}
+		data = (uint8_t*)mapped;
+		return MAP_CREATE_OK;
+#endif
+	}
+};
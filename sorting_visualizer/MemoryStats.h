@@ -0,0 +1,131 @@
+#pragma once
+
+#include <atomic>
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#else
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+
+//what a tracked allocation is used for
+enum MemCategory {
+	MEM_IMAGE,		//the decoded rgb image
+	MEM_PIXELS,		//the Pixel array being sorted
+	MEM_SCRATCH,	//temporary arrays inside the sorts
+	MEM_FRAMES,		//frame buffers handed to / owned by the capture
+	MEM_ENCODER,	//frames the encoder keeps for itself (estimated from its settings)
+	MEM_OUTPUT,		//encoded video kept in memory instead of a file
+	MEM_CATEGORIES
+};
+
+inline const char* memCategoryName(int category) {
+	static const char* names[MEM_CATEGORIES] = { "image", "pixel array", "scratch", "frames", "encoder", "output" };
+	return names[category];
+}
+
+//current and peak bytes per category, shared by every thread in the process
+struct MemoryStats {
+	std::atomic<long long> current[MEM_CATEGORIES];
+	std::atomic<long long> peak[MEM_CATEGORIES];
+	std::atomic<long long> totalCurrent;
+	std::atomic<long long> totalPeak;
+	std::atomic<long long> budget; //0 means no budget
+	std::atomic<long long> mappedCurrent; //file backed memory (MappedFile), outside the budget
+	std::atomic<long long> mappedPeak;
+
+	MemoryStats() {
+		for (int i = 0; i < MEM_CATEGORIES; i++) {
+			current[i] = 0;
+			peak[i] = 0;
+		}
+		totalCurrent = 0;
+		totalPeak = 0;
+		budget = 0;
+		mappedCurrent = 0;
+		mappedPeak = 0;
+	}
+};
+
+inline MemoryStats& memoryStats() {
+	static MemoryStats stats;
+	return stats;
+}
+
+inline void raisePeak(std::atomic<long long>& peak, long long value) {
+	long long old = peak.load();
+	while (value > old && !peak.compare_exchange_weak(old, value)) {
+	}
+}
+
+//call before allocating, throws if the allocation would go over the budget
+inline void trackAlloc(MemCategory category, long long bytes) {
+	MemoryStats& stats = memoryStats();
+	long long total = stats.totalCurrent.fetch_add(bytes) + bytes;
+	long long budget = stats.budget.load();
+	if (budget > 0 && total > budget) {
+		stats.totalCurrent.fetch_sub(bytes);
+		throw std::runtime_error("memory budget exceeded allocating " + std::to_string(bytes) + " bytes for " + memCategoryName(category));
+	}
+	long long current = stats.current[category].fetch_add(bytes) + bytes;
+	raisePeak(stats.peak[category], current);
+	raisePeak(stats.totalPeak, total);
+}
+
+inline void trackFree(MemCategory category, long long bytes) {
+	MemoryStats& stats = memoryStats();
+	stats.current[category].fetch_sub(bytes);
+	stats.totalCurrent.fetch_sub(bytes);
+}
+
+//file backed mappings can be paged out to their file, so they're counted on their own
+inline void trackMapped(long long bytes) {
+	MemoryStats& stats = memoryStats();
+	raisePeak(stats.mappedPeak, stats.mappedCurrent.fetch_add(bytes) + bytes);
+}
+
+inline void untrackMapped(long long bytes) {
+	memoryStats().mappedCurrent.fetch_sub(bytes);
+}
+
+//highest resident memory the process has reached, in bytes
+inline long long peakRSS() {
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS pmc;
+	if (GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc))) {
+		return (long long)pmc.PeakWorkingSetSize;
+	}
+	return 0;
+#else
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+	return (long long)usage.ru_maxrss;
+#else
+	return (long long)usage.ru_maxrss * 1024;
+#endif
+#endif
+}
+
+inline void printMemoryReport() {
+	MemoryStats& stats = memoryStats();
+	printf("memory        current MB   peak MB\n");
+	for (int i = 0; i < MEM_CATEGORIES; i++) {
+		printf("%-13s %-12.2f %-12.2f\n", memCategoryName(i), stats.current[i] / 1048576.0, stats.peak[i] / 1048576.0);
+	}
+	printf("%-13s %-12.2f %-12.2f\n", "total", stats.totalCurrent / 1048576.0, stats.totalPeak / 1048576.0);
+	if (stats.mappedPeak > 0) {
+		printf("%-13s %-12.2f %-12.2f\n", "mapped files", stats.mappedCurrent / 1048576.0, stats.mappedPeak / 1048576.0);
+	}
+	printf("%-13s %-12s %-12.2f\n", "process rss", "", peakRSS() / 1048576.0);
+	if (stats.budget > 0) {
+		printf("%-13s %-12s %-12.2f\n", "budget", "", stats.budget / 1048576.0);
+	}
+}
@@ -0,0 +1,184 @@
+#pragma once
+
+#include <stdint.h>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "VideoCapture.h"
+
+//hands every frame to several captures (e.g. the full size video and a small
+//preview), each on its own thread, so the sort runs once and the encodes run in
+//parallel. a frame is copied once into a shared slot that every rendition reads,
+//and the slot is reused when the last one is done with it. AddFrame waits when
+//all MULTI_CAPTURE_SLOTS slots are still queued behind the slowest rendition
+#define MULTI_CAPTURE_SLOTS 4
+
+class MultiCapture : public CaptureSink {
+public:
+
+	MultiCapture() {
+		frameBytes = 0;
+		slotBytes = 0;
+		stopping = false;
+		started = false;
+	}
+
+	~MultiCapture() {
+		Finish();
+		for (size_t i = 0; i < renditions.size(); i++) {
+			delete renditions[i]->capture;
+			delete renditions[i];
+		}
+	}
+
+	//takes ownership of capture, before Init. bitrate 0 uses the one given to Init
+	void Add(CaptureSink* capture, int bitrate = 0) {
+		Rendition* rendition = new Rendition();
+		rendition->capture = capture;
+		rendition->bitrate = bitrate;
+		renditions.push_back(rendition);
+	}
+
+	void Init(int width, int height, int fpsrate, int bitrate) {
+		frameBytes = (size_t)width * height * 3;
+		slotBytes = (long long)frameBytes * MULTI_CAPTURE_SLOTS;
+		trackAlloc(MEM_FRAMES, slotBytes);
+		for (int i = 0; i < MULTI_CAPTURE_SLOTS; i++) {
+			FrameSlot* slot = new FrameSlot();
+			slot->data = new uint8_t[frameBytes];
+			slot->pending = 0;
+			slots.push_back(slot);
+			freeSlots.push_back(slot);
+		}
+		for (size_t i = 0; i < renditions.size(); i++) {
+			renditions[i]->capture->SetLogger(logger);
+			renditions[i]->capture->Init(width, height, fpsrate, renditions[i]->bitrate > 0 ? renditions[i]->bitrate : bitrate);
+		}
+		for (size_t i = 0; i < renditions.size(); i++) {
+			renditions[i]->thread = std::thread(&MultiCapture::work, this, renditions[i]);
+		}
+		started = true;
+	}
+
+	void AddFrame(uint8_t *data) {
+		if (!started) {
+			return;
+		}
+		std::unique_lock<std::mutex> lock(slotMutex);
+		slotFree.wait(lock, [this]() { return !freeSlots.empty(); });
+		FrameSlot* slot = freeSlots.back();
+		freeSlots.pop_back();
+		lock.unlock();
+
+		memcpy(slot->data, data, frameBytes);
+		slot->info = info;
+
+		lock.lock();
+		slot->pending = (int)renditions.size();
+		for (size_t i = 0; i < renditions.size(); i++) {
+			renditions[i]->queue.push_back(slot);
+		}
+		lock.unlock();
+		frameQueued.notify_all();
+	}
+
+	//waits for every rendition to encode what's queued, then finishes them all in parallel
+	void Finish() {
+		if (started) {
+			{
+				std::lock_guard<std::mutex> lock(slotMutex);
+				stopping = true;
+			}
+			frameQueued.notify_all();
+			for (size_t i = 0; i < renditions.size(); i++) {
+				renditions[i]->thread.join();
+			}
+			started = false;
+		}
+		//also reached when a rendition's Init threw
+		if (!slots.empty()) {
+			for (size_t i = 0; i < slots.size(); i++) {
+				delete[] slots[i]->data;
+				delete slots[i];
+			}
+			slots.clear();
+			freeSlots.clear();
+			trackFree(MEM_FRAMES, slotBytes);
+		}
+	}
+
+private:
+
+	struct FrameSlot {
+		uint8_t* data;
+		FrameInfo info;
+		int pending; //renditions that haven't encoded it yet
+	};
+
+	struct Rendition {
+		CaptureSink* capture;
+		int bitrate;
+		std::deque<FrameSlot*> queue;
+		std::thread thread;
+	};
+
+	size_t frameBytes;
+	long long slotBytes;
+	bool stopping;
+	bool started;
+	std::vector<Rendition*> renditions;
+	std::vector<FrameSlot*> slots;
+	std::vector<FrameSlot*> freeSlots;
+	std::mutex slotMutex;
+	std::condition_variable frameQueued;
+	std::condition_variable slotFree;
+
+	void work(Rendition* rendition) {
+		bool failed = false;
+		while (true) {
+			std::unique_lock<std::mutex> lock(slotMutex);
+			frameQueued.wait(lock, [this, rendition]() { return stopping || !rendition->queue.empty(); });
+			if (rendition->queue.empty()) {
+				break;
+			}
+			FrameSlot* slot = rendition->queue.front();
+			rendition->queue.pop_front();
+			lock.unlock();
+
+			//a rendition that failed (e.g. over the memory budget) keeps releasing
+			//its slots so the others aren't held up
+			if (!failed) {
+				try {
+					rendition->capture->SetFrameInfo(slot->info);
+					rendition->capture->AddFrame(slot->data);
+				}
+				catch (const std::exception& e) {
+					logger->Debug(std::string("Rendition stopped: ") + e.what(), 0);
+					failed = true;
+				}
+			}
+
+			lock.lock();
+			bool last = --slot->pending == 0;
+			if (last) {
+				freeSlots.push_back(slot);
+			}
+			lock.unlock();
+			if (last) {
+				slotFree.notify_one();
+			}
+		}
+		try {
+			rendition->capture->Finish();
+		}
+		catch (const std::exception& e) {
+			logger->Debug(std::string("Rendition failed to finish: ") + e.what(), 0);
+		}
+	}
+};
@@ -0,0 +1,151 @@
+#pragma once
+
+#include <stdint.h>
+#include <cstdio>
+#include <string>
+#include <iostream>
+#include <mutex>
+
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#define rawDup _dup
+#define rawDup2 _dup2
+#define rawFileno _fileno
+#define rawFdopen _fdopen
+#else
+#include <signal.h>
+#include <unistd.h>
+#define rawDup dup
+#define rawDup2 dup2
+#define rawFileno fileno
+#define rawFdopen fdopen
+#endif
+
+#include "VideoCapture.h"
+#include "YuvConverter.h"
+
+//the real stdout, kept for video, while the process' own stdout is pointed at
+//stderr so nothing else ends up in the stream. the first call does the swap,
+//so call it before printing anything if the video will go to stdout
+inline int videoStdout() {
+	static int videoFd = -1;
+	static std::once_flag swapped;
+	std::call_once(swapped, []() {
+		std::cout.flush();
+		fflush(stdout);
+		if ((videoFd = rawDup(rawFileno(stdout))) >= 0) {
+			rawDup2(rawFileno(stderr), rawFileno(stdout));
+#ifdef _WIN32
+			_setmode(videoFd, _O_BINARY);
+#endif
+		}
+	});
+	return videoFd;
+}
+
+//writes uncompressed frames to a file, a named pipe or stdout ("-") without
+//going through libavcodec, so another encoder can be chained on:
+//  y4m      YUV4MPEG2 stream (4:2:0), e.g. | ffmpeg -i - ...
+//  yuv420p  bare planar 4:2:0 frames, the reader has to be told the size and rate
+//  rgb24    the frames exactly as the sorts draw them
+//the 4:2:0 formats are BT.601 limited range (what ffmpeg assumes for y4m and
+//yuv420p input), converted like the video is, odd sizes get a half chroma
+//column/row like y4m expects
+class RawCapture : public CaptureSink {
+public:
+
+	RawCapture(std::string rawFormat, std::string fileName) {
+		format = rawFormat;
+		outFileName = fileName;
+		out = NULL;
+		frameBuffer = NULL;
+		frameBufferBytes = 0;
+		outBytes = 0;
+		width = 0;
+		height = 0;
+		failed = false;
+	}
+
+	~RawCapture() {
+		Finish();
+	}
+
+	void Init(int frameWidth, int frameHeight, int fpsrate, int bitrate) {
+		width = frameWidth;
+		height = frameHeight;
+		if (format == "rgb24") {
+			outBytes = (size_t)width * height * 3;
+		}
+		else {
+			outBytes = (size_t)width * height + 2 * (size_t)((width + 1) / 2) * ((height + 1) / 2);
+			frameBufferBytes = outBytes;
+			trackAlloc(MEM_FRAMES, frameBufferBytes);
+			frameBuffer = new uint8_t[frameBufferBytes];
+		}
+
+		if (!(out = openOutput())) {
+			logger->Debug("Failed to open raw output " + outFileName, 0);
+			return;
+		}
+#ifndef _WIN32
+		//a reader that goes away should end the stream, not the process
+		signal(SIGPIPE, SIG_IGN);
+#endif
+		if (format == "y4m") {
+			//C420jpeg is y4m's default 4:2:0 siting
+			fprintf(out, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg\n", width, height, fpsrate);
+		}
+	}
+
+	void AddFrame(uint8_t *data) {
+		if (!out || failed) {
+			return;
+		}
+		const uint8_t* frame = data;
+		if (frameBuffer) {
+			int chromaWidth = (width + 1) / 2;
+			uint8_t* planes[3] = { frameBuffer, frameBuffer + (size_t)width * height, frameBuffer + (size_t)width * height + (size_t)chromaWidth * ((height + 1) / 2) };
+			int linesizes[3] = { width, chromaWidth, chromaWidth };
+			converter.Convert(data, width, height, planes, linesizes);
+			frame = frameBuffer;
+		}
+		if ((format == "y4m" && fputs("FRAME\n", out) < 0) || fwrite(frame, 1, outBytes, out) != outBytes) {
+			logger->Debug("Failed to write raw frame, the reader probably closed the pipe", 0);
+			failed = true;
+		}
+	}
+
+	void Finish() {
+		if (out) {
+			fclose(out);
+			out = NULL;
+		}
+		if (frameBuffer) {
+			delete[] frameBuffer;
+			frameBuffer = NULL;
+			trackFree(MEM_FRAMES, frameBufferBytes);
+		}
+	}
+
+private:
+
+	std::string format;
+	std::string outFileName;
+	FILE *out;
+	uint8_t *frameBuffer; //converted frame, NULL for rgb24
+	YuvConverter converter;
+	size_t frameBufferBytes;
+	size_t outBytes;
+	int width;
+	int height;
+	bool failed;
+
+	FILE* openOutput() {
+		if (outFileName != "-") {
+			return fopen(outFileName.c_str(), "wb");
+		}
+		int videoFd = videoStdout();
+		return videoFd >= 0 ? rawFdopen(videoFd, "wb") : NULL;
+	}
+};
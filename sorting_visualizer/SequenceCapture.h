@@ -0,0 +1,330 @@
+#pragma once
+
+#include <stdint.h>
+#include <algorithm>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#include <direct.h>
+#define makeDir(path) _mkdir(path)
+#else
+#include <sys/stat.h>
+#define makeDir(path) mkdir(path, 0755)
+#endif
+
+#include "VideoCapture.h"
+
+//QOI ("quite ok image format", qoiformat.org), lossless and several times
+//faster to write than png, appends the whole file to out
+inline void qoiEncode(const uint8_t* rgb, int width, int height, std::vector<uint8_t>& out) {
+	uint8_t index[64][4];
+	memset(index, 0, sizeof(index));
+	uint8_t header[14] = { 'q', 'o', 'i', 'f',
+		(uint8_t)(width >> 24), (uint8_t)(width >> 16), (uint8_t)(width >> 8), (uint8_t)width,
+		(uint8_t)(height >> 24), (uint8_t)(height >> 16), (uint8_t)(height >> 8), (uint8_t)height,
+		3, 0 };
+	out.insert(out.end(), header, header + 14);
+
+	int r = 0, g = 0, b = 0;
+	int run = 0;
+	size_t pixels = (size_t)width * height;
+	for (size_t i = 0; i < pixels; i++) {
+		int pr = r, pg = g, pb = b;
+		r = rgb[i * 3];
+		g = rgb[i * 3 + 1];
+		b = rgb[i * 3 + 2];
+		if (r == pr && g == pg && b == pb) {
+			run++;
+			if (run == 62 || i == pixels - 1) {
+				out.push_back((uint8_t)(0xc0 | (run - 1)));
+				run = 0;
+			}
+			continue;
+		}
+		if (run) {
+			out.push_back((uint8_t)(0xc0 | (run - 1)));
+			run = 0;
+		}
+		//alpha is always 255
+		int hash = (r * 3 + g * 5 + b * 7 + 255 * 11) % 64;
+		if (index[hash][0] == r && index[hash][1] == g && index[hash][2] == b && index[hash][3] == 255) {
+			out.push_back((uint8_t)hash);
+			continue;
+		}
+		index[hash][0] = (uint8_t)r;
+		index[hash][1] = (uint8_t)g;
+		index[hash][2] = (uint8_t)b;
+		index[hash][3] = 255;
+
+		int dr = (int8_t)(uint8_t)(r - pr), dg = (int8_t)(uint8_t)(g - pg), db = (int8_t)(uint8_t)(b - pb);
+		int drg = dr - dg, dbg = db - dg;
+		if (dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1) {
+			out.push_back((uint8_t)(0x40 | (dr + 2) << 4 | (dg + 2) << 2 | (db + 2)));
+		}
+		else if (dg >= -32 && dg <= 31 && drg >= -8 && drg <= 7 && dbg >= -8 && dbg <= 7) {
+			out.push_back((uint8_t)(0x80 | (dg + 32)));
+			out.push_back((uint8_t)((drg + 8) << 4 | (dbg + 8)));
+		}
+		else {
+			out.push_back(0xfe);
+			out.push_back((uint8_t)r);
+			out.push_back((uint8_t)g);
+			out.push_back((uint8_t)b);
+		}
+	}
+	static const uint8_t padding[8] = { 0, 0, 0, 0, 0, 0, 0, 1 };
+	out.insert(out.end(), padding, padding + 8);
+}
+
+//writes every frame as its own image (frame_000000.png, ...) into a directory,
+//plus manifest.csv listing the files with the operation each frame shows.
+//AddFrame only copies the frame into a free buffer and queues it, a pool of
+//workers compresses (png through libavcodec, each worker with its own encoder,
+//or qoi) and writes. at most SEQUENCE_IN_FLIGHT frames per worker are buffered,
+//AddFrame waits when they're all in use
+#define SEQUENCE_IN_FLIGHT 2
+
+class SequenceCapture : public CaptureSink {
+public:
+
+	SequenceCapture(std::string imageFormat, std::string directory, int workerCount = 0) {
+		format = imageFormat;
+		dirName = directory;
+		workers = workerCount > 0 ? workerCount : std::max(1, (int)std::thread::hardware_concurrency() - 1);
+		width = 0;
+		height = 0;
+		frameBytes = 0;
+		bufferBytes = 0;
+		frameCounter = 0;
+		failures = 0;
+		stopping = false;
+		started = false;
+	}
+
+	~SequenceCapture() {
+		Finish();
+	}
+
+	void Init(int frameWidth, int frameHeight, int fpsrate, int bitrate) {
+		width = frameWidth;
+		height = frameHeight;
+		frameBytes = (size_t)width * height * 3;
+		if (makeDir(dirName.c_str()) != 0 && errno != EEXIST) {
+			logger->Debug("Failed to create frame directory " + dirName, 0);
+			return;
+		}
+
+		bufferBytes = (long long)frameBytes * workers * SEQUENCE_IN_FLIGHT;
+		trackAlloc(MEM_FRAMES, bufferBytes);
+		for (int i = 0; i < workers * SEQUENCE_IN_FLIGHT; i++) {
+			buffers.push_back(new uint8_t[frameBytes]);
+			freeBuffers.push_back(buffers.back());
+		}
+		for (int i = 0; i < workers; i++) {
+			pool.push_back(std::thread(&SequenceCapture::work, this));
+		}
+		started = true;
+	}
+
+	void AddFrame(uint8_t *data) {
+		if (!started) {
+			return;
+		}
+		std::unique_lock<std::mutex> lock(queueMutex);
+		bufferFree.wait(lock, [this]() { return !freeBuffers.empty(); });
+		uint8_t* buffer = freeBuffers.back();
+		freeBuffers.pop_back();
+		lock.unlock();
+
+		memcpy(buffer, data, frameBytes);
+		ManifestEntry entry;
+		entry.operation = info.operation;
+		entry.changed = info.changed;
+		entry.bytes = 0;
+
+		lock.lock();
+		QueuedFrame frame = { frameCounter++, buffer };
+		manifest.push_back(entry);
+		queue.push_back(frame);
+		lock.unlock();
+		frameQueued.notify_one();
+	}
+
+	void Finish() {
+		if (!started) {
+			return;
+		}
+		{
+			std::lock_guard<std::mutex> lock(queueMutex);
+			stopping = true;
+		}
+		frameQueued.notify_all();
+		for (size_t i = 0; i < pool.size(); i++) {
+			pool[i].join();
+		}
+		pool.clear();
+		for (size_t i = 0; i < buffers.size(); i++) {
+			delete[] buffers[i];
+		}
+		buffers.clear();
+		freeBuffers.clear();
+		trackFree(MEM_FRAMES, bufferBytes);
+		writeManifest();
+		if (failures) {
+			logger->Debug("Frames that couldn't be written", failures);
+		}
+		started = false;
+	}
+
+private:
+
+	struct QueuedFrame {
+		int index;
+		uint8_t* data;
+	};
+
+	struct ManifestEntry {
+		unsigned long long operation;
+		unsigned int changed;
+		size_t bytes; //0 if the frame couldn't be written
+	};
+
+	std::string format;
+	std::string dirName;
+	int workers;
+	int width;
+	int height;
+	size_t frameBytes;
+	long long bufferBytes;
+	int frameCounter;
+	int failures;
+	bool stopping;
+	bool started;
+
+	std::vector<uint8_t*> buffers;
+	std::vector<uint8_t*> freeBuffers;
+	std::deque<QueuedFrame> queue;
+	std::vector<ManifestEntry> manifest;
+	std::vector<std::thread> pool;
+	std::mutex queueMutex;
+	std::condition_variable frameQueued;
+	std::condition_variable bufferFree;
+
+	std::string frameFileName(int index) {
+		char name[32];
+		snprintf(name, sizeof(name), "frame_%06d.%s", index, format.c_str());
+		return name;
+	}
+
+	void work() {
+		AVCodecContext* pngCtx = NULL;
+		AVFrame* pngFrame = NULL;
+		AVPacket* pkt = NULL;
+		if (format == "png") {
+			AVCodec* codec = avcodec_find_encoder(AV_CODEC_ID_PNG);
+			if (codec && (pngCtx = avcodec_alloc_context3(codec))) {
+				pngCtx->opaque = logger;
+				pngCtx->width = width;
+				pngCtx->height = height;
+				pngCtx->pix_fmt = AV_PIX_FMT_RGB24;
+				pngCtx->time_base = { 1, 25 };
+				int err;
+				if ((err = avcodec_open2(pngCtx, codec, NULL)) < 0) {
+					logger->Debug("Failed to open png encoder", err);
+					avcodec_free_context(&pngCtx);
+				}
+			}
+			pngFrame = av_frame_alloc();
+			pkt = av_packet_alloc();
+		}
+		std::vector<uint8_t> encoded;
+
+		while (true) {
+			std::unique_lock<std::mutex> lock(queueMutex);
+			frameQueued.wait(lock, [this]() { return stopping || !queue.empty(); });
+			if (queue.empty()) {
+				break;
+			}
+			QueuedFrame frame = queue.front();
+			queue.pop_front();
+			lock.unlock();
+
+			encoded.clear();
+			if (format == "qoi") {
+				qoiEncode(frame.data, width, height, encoded);
+			}
+			else if (pngCtx && pngFrame && pkt) {
+				encodePng(pngCtx, pngFrame, pkt, frame.data, encoded);
+			}
+
+			size_t written = 0;
+			if (!encoded.empty()) {
+				std::string path = dirName + "/" + frameFileName(frame.index);
+				FILE* file = fopen(path.c_str(), "wb");
+				if (file) {
+					written = fwrite(encoded.data(), 1, encoded.size(), file) == encoded.size() ? encoded.size() : 0;
+					fclose(file);
+				}
+			}
+
+			lock.lock();
+			manifest[frame.index].bytes = written;
+			if (!written) {
+				failures++;
+			}
+			freeBuffers.push_back(frame.data);
+			lock.unlock();
+			bufferFree.notify_one();
+		}
+
+		if (pngCtx) {
+			avcodec_free_context(&pngCtx);
+		}
+		if (pngFrame) {
+			av_frame_free(&pngFrame);
+		}
+		if (pkt) {
+			av_packet_free(&pkt);
+		}
+	}
+
+	void encodePng(AVCodecContext* pngCtx, AVFrame* pngFrame, AVPacket* pkt, uint8_t* data, std::vector<uint8_t>& encoded) {
+		//the frame points straight at the queued buffer, no copy or conversion
+		pngFrame->format = AV_PIX_FMT_RGB24;
+		pngFrame->width = width;
+		pngFrame->height = height;
+		av_image_fill_arrays(pngFrame->data, pngFrame->linesize, data, AV_PIX_FMT_RGB24, width, height, 1);
+		int err;
+		if ((err = avcodec_send_frame(pngCtx, pngFrame)) < 0) {
+			logger->Debug("Failed to send frame to png encoder", err);
+			return;
+		}
+		if (avcodec_receive_packet(pngCtx, pkt) == 0) {
+			encoded.assign(pkt->data, pkt->data + pkt->size);
+			av_packet_unref(pkt);
+		}
+	}
+
+	void writeManifest() {
+		std::string path = dirName + "/manifest.csv";
+		FILE* file = fopen(path.c_str(), "w");
+		if (!file) {
+			logger->Debug("Failed to write " + path, 0);
+			return;
+		}
+		fprintf(file, "frame,file,operation,pixels_changed,bytes\n");
+		for (size_t i = 0; i < manifest.size(); i++) {
+			fprintf(file, "%zu,%s,%llu,%u,%zu\n", i, manifest[i].bytes ? frameFileName((int)i).c_str() : "", manifest[i].operation, manifest[i].changed, manifest[i].bytes);
+		}
+		fclose(file);
+		manifest.clear();
+	}
+};
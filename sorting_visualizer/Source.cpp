@@ -3,58 +3,118 @@
 #include <string>
 #include <iostream>
 #include <vector>
+#include <chrono>
+#include <random>
+#include <fstream>
+#include <sstream>
+#include <map>
+#include <algorithm>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <ctime>
+#include <climits>
+#include <cstddef>
 
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 
 #include "VideoCapture.h"
-#define VIDEO_TMP_FILE "tmp.h264"
-#define FINAL_FILE_NAME "sortingSample.mp4"
+#include "HashCapture.h"
+#include "RawCapture.h"
+#include "SequenceCapture.h"
+#include "GifCapture.h"
+#include "MultiCapture.h"
+#include "TiledCapture.h"
+#include "ViewportCapture.h"
+#include "MappedFile.h"
+#include "ImageFile.h"
+#include "CpuFeatures.h"
 
 
 void VideoCapture::Init(int width, int height, int fpsrate, int bitrate) {
 
 	fps = fpsrate;
 
+	//frames come in at width x height and are scaled to the rendition size
+	srcWidth = width;
+	srcHeight = height;
+	if (outWidth > 0 && outHeight > 0) {
+		width = outWidth;
+		height = outHeight;
+	}
+	else if (fitWidth > 0 && fitHeight > 0 && (width > fitWidth || height > fitHeight)) {
+		//whichever side runs into the box first decides the scale
+		if ((long long)fitWidth * height <= (long long)fitHeight * width) {
+			height = (int)((long long)height * fitWidth / width);
+			width = fitWidth;
+		}
+		else {
+			width = (int)((long long)width * fitHeight / height);
+			height = fitHeight;
+		}
+		width = std::max(2, width & ~1);
+		height = std::max(2, height & ~1);
+	}
+
+	//whole ratios are averaged down before the scaler, which then only converts
+	areaX = 1;
+	areaY = 1;
+	if ((width < srcWidth || height < srcHeight) && srcWidth % width == 0 && srcHeight % height == 0) {
+		areaX = srcWidth / width;
+		areaY = srcHeight / height;
+	}
+
 	int err;
 
+	//fragmented output is muxed straight into the final file
+	const std::string& outFileName = fragmentFrames ? finalFileName : tmpFileName;
+
 	//get format from file name (given mp4, h264, ect...)
-	if (!(oformat = av_guess_format(NULL, VIDEO_TMP_FILE, NULL))) {
-		Debug("Failed to define output format", 0);
+	if (!(oformat = av_guess_format(NULL, outFileName.c_str(), NULL))) {
+		logger->Debug("Failed to define output format", 0);
+		return;
+	}
+	bool isMp4 = !strcmp(oformat->name, "mp4") || !strcmp(oformat->name, "mov");
+	if (fragmentFrames && !isMp4 && strcmp(oformat->name, "matroska")) {
+		logger->Debug("Fragmented output needs an mp4 or mkv file name", 0);
 		return;
 	}
 
 	//allocate space for the context (needs to be done dynamically depending on format)
-	if ((err = avformat_alloc_output_context2(&ofctx, oformat, NULL, VIDEO_TMP_FILE) < 0)) {
-		Debug("Failed to allocate output context", err);
+	if ((err = avformat_alloc_output_context2(&ofctx, oformat, NULL, outFileName.c_str()) < 0)) {
+		logger->Debug("Failed to allocate output context", err);
 		Free();
 		return;
 	}
+	ofctx->opaque = logger; //so avlog_cb can find this capture's log
 
-	//find an encoder based off of the format codec
-	if (!(codec = avcodec_find_encoder(oformat->video_codec))) {
-		Debug("Failed to find encoder", 0);
+	//find an encoder based off of the format codec, unless one was asked for
+	codec = codecName.empty() ? avcodec_find_encoder(oformat->video_codec) : avcodec_find_encoder_by_name(codecName.c_str());
+	if (!codec) {
+		logger->Debug("Failed to find encoder", 0);
 		Free();
 		return;
 	}
 
 	//create a new stream based on the format context as well as the codec
 	if (!(videoStream = avformat_new_stream(ofctx, codec))) {
-		Debug("Failed to create new stream", 0);
+		logger->Debug("Failed to create new stream", 0);
 		Free();
 		return;
 	}
 
 	//allocate context for the codec (needs to be done dynamically, same reason as above)
 	if (!(cctx = avcodec_alloc_context3(codec))) {
-		Debug("Failed to allocate codec context", 0);
+		logger->Debug("Failed to allocate codec context", 0);
 		Free();
 		return;
 	}
+	cctx->opaque = logger;
 
 
 	//setting parameters on the codec parameters for the stream
-	videoStream->codecpar->codec_id = oformat->video_codec;
+	videoStream->codecpar->codec_id = codec->id;
 	videoStream->codecpar->codec_type = AVMEDIA_TYPE_VIDEO;
 	videoStream->codecpar->width = width;
 	videoStream->codecpar->height = height;
@@ -68,6 +128,11 @@ void VideoCapture::Init(int width, int height, int fpsrate, int bitrate) {
 	cctx->max_b_frames = 2;
 	cctx->gop_size = 12;
 
+	//how the frames are converted, so players convert them back the same way
+	cctx->colorspace = colorMatrix == YUV_BT709 ? AVCOL_SPC_BT709 : AVCOL_SPC_SMPTE170M;
+	cctx->color_range = fullRange ? AVCOL_RANGE_JPEG : AVCOL_RANGE_MPEG;
+	converter.SetColors(colorMatrix, fullRange);
+
 	//set presets
 	if (videoStream->codecpar->codec_id == AV_CODEC_ID_H264) {
 		av_opt_set(cctx, "preset", "ultrafast", 0);
@@ -83,34 +148,64 @@ void VideoCapture::Init(int width, int height, int fpsrate, int bitrate) {
 
 	//opening the codec
 	if ((err = avcodec_open2(cctx, codec, NULL)) < 0) {
-		Debug("Failed to open codec", err);
+		logger->Debug("Failed to open codec", err);
 		Free();
 		return;
 	}
+	//the encoder keeps its reference frames, the b frames it holds back and
+	//(x264) its lookahead as yuv frames of its own, estimated from its settings
+	//since other threads grow the process too
+	int64_t lookahead = 0;
+	if (av_opt_get_int(cctx->priv_data, "rc-lookahead", 0, &lookahead) < 0 || lookahead < 0) {
+		lookahead = 0;
+	}
+	long long encoderFrames = std::max(1, cctx->refs) + std::max(0, cctx->max_b_frames) + lookahead + 1;
+	encoderBytes = encoderFrames * av_image_get_buffer_size(AV_PIX_FMT_YUV420P, cctx->width, cctx->height, 1);
+	trackAlloc(MEM_ENCODER, encoderBytes);
 
 	//opening the file for 
-	if (!(oformat->flags & AVFMT_NOFILE)) {
-		if ((err = avio_open(&ofctx->pb, VIDEO_TMP_FILE, AVIO_FLAG_WRITE)) < 0) {
-			Debug("Failed to open file", err);
+	if (memoryOutput) {
+		if (!(ofctx->pb = openMemoryIO(fragmentFrames ? &finalIO : &tmpIO, true))) {
+			logger->Debug("Failed to allocate memory output", 0);
+			Free();
+			return;
+		}
+		ofctx->flags |= AVFMT_FLAG_CUSTOM_IO;
+	}
+	else if (!(oformat->flags & AVFMT_NOFILE)) {
+		if ((err = avio_open(&ofctx->pb, outFileName.c_str(), AVIO_FLAG_WRITE)) < 0) {
+			logger->Debug("Failed to open file", err);
 			Free();
 			return;
 		}
 	}
 
-	//writing header to the file
-	if ((err = avformat_write_header(ofctx, NULL)) < 0) {
-		Debug("Failed to write header", err);
+	//writing header to the file, an mp4 gets an empty moov up front and a fragment
+	//whenever AddFrame asks for one (mkv ends a cluster instead, and keeps its cues at the end)
+	AVDictionary *headerOptions = NULL;
+	if (fragmentFrames && isMp4) {
+		av_dict_set(&headerOptions, "movflags", "frag_custom+empty_moov+default_base_moof", 0);
+	}
+	err = avformat_write_header(ofctx, &headerOptions);
+	av_dict_free(&headerOptions);
+	if (err < 0) {
+		logger->Debug("Failed to write header", err);
 		Free();
 		return;
 	}
 
 	//printing format info into the file
-	av_dump_format(ofctx, 0, VIDEO_TMP_FILE, 1);
+	av_dump_format(ofctx, 0, outFileName.c_str(), 1);
 }
 
 void VideoCapture::AddFrame(uint8_t *data) {
 	int err;
 
+	//Init failed, nothing to encode with
+	if (!cctx) {
+		return;
+	}
+
 	//create the video frame if its the first frame
 	if (!videoFrame) {
 		videoFrame = av_frame_alloc();
@@ -118,29 +213,67 @@ void VideoCapture::AddFrame(uint8_t *data) {
 		videoFrame->width = cctx->width;
 		videoFrame->height = cctx->height;
 
+		frameBytes = av_image_get_buffer_size(AV_PIX_FMT_YUV420P, cctx->width, cctx->height, 32);
+		if (areaX > 1 || areaY > 1) {
+			frameBytes += (long long)cctx->width * cctx->height * 3;
+		}
+		trackAlloc(MEM_FRAMES, frameBytes);
+		if (areaX > 1 || areaY > 1) {
+			areaFrame = new uint8_t[(size_t)cctx->width * cctx->height * 3];
+			areaSums.assign((size_t)cctx->width * 3, 0);
+		}
 		if ((err = av_frame_get_buffer(videoFrame, 32)) < 0) {
-			Debug("Failed to allocate picture", err);
+			logger->Debug("Failed to allocate picture", err);
 			return;
 		}
 	}
 
-	//set up for scaling
-	if (!swsCtx) {
-		swsCtx = sws_getContext(cctx->width, cctx->height, AV_PIX_FMT_RGB24, cctx->width, cctx->height, AV_PIX_FMT_YUV420P, SWS_BICUBIC, 0, 0, 0);
+	bool area = areaX > 1 || areaY > 1;
+	int scaleWidth = area ? cctx->width : srcWidth;
+	int scaleHeight = area ? cctx->height : srcHeight;
+
+	//frames at the video's size only need their colors converted, which the converter
+	//does without swscale's general scaling path
+	bool convertOnly = scaleWidth == cctx->width && scaleHeight == cctx->height;
+
+	//set up for scaling, once. area averages whatever is shrunk more smoothly (and
+	//cheaper) than bicubic
+	if (!swsCtx && !convertOnly) {
+		int flags = scaleWidth > cctx->width || scaleHeight > cctx->height ? SWS_AREA : SWS_BICUBIC;
+		swsCtx = sws_getContext(scaleWidth, scaleHeight, AV_PIX_FMT_RGB24, cctx->width, cctx->height, AV_PIX_FMT_YUV420P, flags, 0, 0, 0);
+		if (swsCtx) {
+			//the converter's colors, rgb is always full range
+			const int* coefficients = sws_getCoefficients(colorMatrix == YUV_BT709 ? SWS_CS_ITU709 : SWS_CS_ITU601);
+			sws_setColorspaceDetails(swsCtx, coefficients, 1, coefficients, fullRange ? 1 : 0, 0, 1 << 16, 1 << 16);
+		}
 	}
 
 	//setting the linesize to be 3x the width (RGB, 3 elements per pixel?)
-	int inLinesize[1] = { 3 * cctx->width };
+	int inLinesize[1] = { 3 * scaleWidth };
+
+	std::chrono::steady_clock::time_point convertStart = std::chrono::steady_clock::now();
+
+	if (area) {
+		averageArea(data);
+		data = areaFrame;
+	}
 
 	//resizing the next frame
-	sws_scale(swsCtx, (const uint8_t * const *)&data, inLinesize, 0, cctx->height, videoFrame->data, videoFrame->linesize);
+	if (convertOnly) {
+		converter.Convert(data, scaleWidth, scaleHeight, videoFrame->data, videoFrame->linesize);
+	}
+	else {
+		sws_scale(swsCtx, (const uint8_t * const *)&data, inLinesize, 0, scaleHeight, videoFrame->data, videoFrame->linesize);
+	}
+
+	std::chrono::steady_clock::time_point encodeStart = std::chrono::steady_clock::now();
 
 	//setting thee next frame
 	videoFrame->pts = frameCounter++;
 
 	//sending the frame to the codec
 	if ((err = avcodec_send_frame(cctx, videoFrame)) < 0) {
-		Debug("Failed to send frame", err);
+		logger->Debug("Failed to send frame", err);
 		return;
 	}
 
@@ -150,15 +283,41 @@ void VideoCapture::AddFrame(uint8_t *data) {
 	pkt.data = NULL;
 	pkt.size = 0;
 
+	//the packet that comes out belongs to an earlier frame when the encoder
+	//is buffering (b-frames, lookahead), so its pts is written alongside
+	long long packetPts = -1;
+	int packetBytes = 0;
+
 	//recieve the packet and write the frame then free the packet
 	if (avcodec_receive_packet(cctx, &pkt) == 0) {
-		pkt.flags |= AV_PKT_FLAG_KEY;
-		av_interleaved_write_frame(ofctx, &pkt);
-		av_packet_unref(&pkt);
+		packetPts = pkt.pts;
+		packetBytes = pkt.size;
+		if (!fragmentFrames) {
+			pkt.flags |= AV_PKT_FLAG_KEY;
+		}
+		writePacket(&pkt);
+	}
+
+	//everything muxed so far becomes a fragment and goes to the disk
+	if (fragmentFrames && frameCounter % fragmentFrames == 0) {
+		av_interleaved_write_frame(ofctx, NULL);
+		av_write_frame(ofctx, NULL);
+		avio_flush(ofctx->pb);
+	}
+
+	if (statsFile) {
+		std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+		fprintf(statsFile, "%d,%llu,%u,%.3f,%.3f,%lld,%d\n", frameCounter - 1, info.operation, info.changed,
+			std::chrono::duration<double, std::milli>(encodeStart - convertStart).count(),
+			std::chrono::duration<double, std::milli>(end - encodeStart).count(), packetPts, packetBytes);
 	}
 }
 
 void VideoCapture::Finish() {
+	if (!cctx) {
+		return;
+	}
+
 	//DELAYED FRAMES
 	AVPacket pkt;
 	av_init_packet(&pkt);
@@ -169,8 +328,11 @@ void VideoCapture::Finish() {
 	for (;;) {
 		avcodec_send_frame(cctx, NULL);
 		if (avcodec_receive_packet(cctx, &pkt) == 0) {
-			av_interleaved_write_frame(ofctx, &pkt);
-			av_packet_unref(&pkt);
+			//delayed packets get rows with no frame of their own
+			if (statsFile) {
+				fprintf(statsFile, "-1,,,,,%lld,%d\n", (long long)pkt.pts, pkt.size);
+			}
+			writePacket(&pkt);
 		}
 		else {
 			break;
@@ -179,94 +341,126 @@ void VideoCapture::Finish() {
 	
 	//write the trailing stuff to the file
 	av_write_trailer(ofctx);
-	if (!(oformat->flags & AVFMT_NOFILE)) {
+	if (!memoryOutput && !(oformat->flags & AVFMT_NOFILE)) {
 		int err = avio_close(ofctx->pb);
 		if (err < 0) {
-			Debug("Failed to close file", err);
+			logger->Debug("Failed to close file", err);
 		}
 	}
 
 	//free all of the stuff from before
 	Free();
 
-	Remux();
+	//a fragmented file is already the final one, a segment waits for the others
+	if (!fragmentFrames && !finalFileName.empty()) {
+		Remux();
+	}
+}
+
+//each pixel of areaFrame is the rounded average of its areaX x areaY block of data
+void VideoCapture::averageArea(const uint8_t *data) {
+	int width = cctx->width;
+	int rowBytes = width * 3;
+	uint32_t count = (uint32_t)(areaX * areaY);
+	for (int y = 0; y < cctx->height; y++) {
+		std::fill(areaSums.begin(), areaSums.end(), 0);
+		for (int row = 0; row < areaY; row++) {
+			const uint8_t *src = data + (size_t)(y * areaY + row) * srcWidth * 3;
+			for (int x = 0; x < width; x++) {
+				uint32_t *sum = &areaSums[x * 3];
+				for (int k = 0; k < areaX; k++, src += 3) {
+					sum[0] += src[0];
+					sum[1] += src[1];
+					sum[2] += src[2];
+				}
+			}
+		}
+		uint8_t *dst = areaFrame + (size_t)y * rowBytes;
+		for (int i = 0; i < rowBytes; i++) {
+			dst[i] = (uint8_t)((areaSums[i] + count / 2) / count);
+		}
+	}
+}
+
+void VideoCapture::writePacket(AVPacket *pkt) {
+	if (fragmentFrames) {
+		//mp4 and mkv pick their own time base in write_header, the raw stream didn't care
+		av_packet_rescale_ts(pkt, cctx->time_base, videoStream->time_base);
+		pkt->stream_index = videoStream->index;
+	}
+	av_interleaved_write_frame(ofctx, pkt);
+	av_packet_unref(pkt);
 }
 
 void VideoCapture::Free() {
+	trackFree(MEM_FRAMES, frameBytes);
+	trackFree(MEM_ENCODER, encoderBytes);
+	frameBytes = 0;
+	encoderBytes = 0;
 	if (videoFrame) {
 		av_frame_free(&videoFrame);
 	}
+	delete[] areaFrame;
+	areaFrame = NULL;
 	if (cctx) {
 		avcodec_free_context(&cctx);
 	}
 	if (ofctx) {
+		if (ofctx->flags & AVFMT_FLAG_CUSTOM_IO) {
+			closeMemoryIO(&ofctx->pb);
+		}
 		avformat_free_context(ofctx);
+		ofctx = NULL;
 	}
 	if (swsCtx) {
 		sws_freeContext(swsCtx);
+		swsCtx = NULL;
 	}
 }
 
 void VideoCapture::Remux() {
 	AVFormatContext *ifmt_ctx = NULL, *ofmt_ctx = NULL;
+	AVIOContext *inputIO = NULL;
 	int err;
 
 	//open input from the file we just wrote to (the YUV/h264 one)
-	if ((err = avformat_open_input(&ifmt_ctx, VIDEO_TMP_FILE, 0, 0)) < 0) {
-		Debug("Failed to open input file for remuxing", err);
-		if (ifmt_ctx) {
-			avformat_close_input(&ifmt_ctx);
-		}
-		if (ofmt_ctx && !(ofmt_ctx->oformat->flags & AVFMT_NOFILE)) {
-			avio_closep(&ofmt_ctx->pb);
-		}
-		if (ofmt_ctx) {
-			avformat_free_context(ofmt_ctx);
+	if ((ifmt_ctx = avformat_alloc_context())) {
+		ifmt_ctx->opaque = logger;
+		if (memoryOutput) {
+			ifmt_ctx->pb = inputIO = openMemoryIO(&tmpIO, false);
+			ifmt_ctx->flags |= AVFMT_FLAG_CUSTOM_IO;
 		}
 	}
+	if ((err = avformat_open_input(&ifmt_ctx, tmpFileName.c_str(), 0, 0)) < 0) {
+		logger->Debug("Failed to open input file for remuxing", err);
+		//a failed open frees the context but not our AVIOContext
+		closeMemoryIO(&inputIO);
+		closeRemux(&ifmt_ctx, &ofmt_ctx);
+		return;
+	}
 
 	//get stream info for the context
 	if ((err = avformat_find_stream_info(ifmt_ctx, 0)) < 0) {
-		Debug("Failed to retrieve input stream information", err);
-		if (ifmt_ctx) {
-			avformat_close_input(&ifmt_ctx);
-		}
-		if (ofmt_ctx && !(ofmt_ctx->oformat->flags & AVFMT_NOFILE)) {
-			avio_closep(&ofmt_ctx->pb);
-		}
-		if (ofmt_ctx) {
-			avformat_free_context(ofmt_ctx);
-		}
+		logger->Debug("Failed to retrieve input stream information", err);
+		closeRemux(&ifmt_ctx, &ofmt_ctx);
+		return;
 	}
 
 	//open output context for the final file
-	if ((err = avformat_alloc_output_context2(&ofmt_ctx, NULL, NULL, FINAL_FILE_NAME))) {
-		Debug("Failed to allocate output context", err);
-		if (ifmt_ctx) {
-			avformat_close_input(&ifmt_ctx);
-		}
-		if (ofmt_ctx && !(ofmt_ctx->oformat->flags & AVFMT_NOFILE)) {
-			avio_closep(&ofmt_ctx->pb);
-		}
-		if (ofmt_ctx) {
-			avformat_free_context(ofmt_ctx);
-		}
+	if ((err = avformat_alloc_output_context2(&ofmt_ctx, NULL, NULL, finalFileName.c_str()))) {
+		logger->Debug("Failed to allocate output context", err);
+		closeRemux(&ifmt_ctx, &ofmt_ctx);
+		return;
 	}
+	ofmt_ctx->opaque = logger;
 
 	//make two streams (one from the input and one for the context)
 	AVStream *inVideoStream = ifmt_ctx->streams[0];
 	AVStream *outVideoStream = avformat_new_stream(ofmt_ctx, NULL);
 	if (!outVideoStream) {
-		Debug("Failed to allocate output video stream", 0);
-		if (ifmt_ctx) {
-			avformat_close_input(&ifmt_ctx);
-		}
-		if (ofmt_ctx && !(ofmt_ctx->oformat->flags & AVFMT_NOFILE)) {
-			avio_closep(&ofmt_ctx->pb);
-		}
-		if (ofmt_ctx) {
-			avformat_free_context(ofmt_ctx);
-		}
+		logger->Debug("Failed to allocate output video stream", 0);
+		closeRemux(&ifmt_ctx, &ofmt_ctx);
+		return;
 	}
 
 	//set the parameters for the output stream
@@ -274,33 +468,34 @@ void VideoCapture::Remux() {
 	avcodec_parameters_copy(outVideoStream->codecpar, inVideoStream->codecpar);
 	outVideoStream->codecpar->codec_tag = 0;
 
-	if (!(ofmt_ctx->oformat->flags & AVFMT_NOFILE)) {
-		if ((err = avio_open(&ofmt_ctx->pb, FINAL_FILE_NAME, AVIO_FLAG_WRITE)) < 0) {
-			Debug("Failed to open output file", err);
-			if (ifmt_ctx) {
-				avformat_close_input(&ifmt_ctx);
-			}
-			if (ofmt_ctx && !(ofmt_ctx->oformat->flags & AVFMT_NOFILE)) {
-				avio_closep(&ofmt_ctx->pb);
-			}
-			if (ofmt_ctx) {
-				avformat_free_context(ofmt_ctx);
-			}
+	AVDictionary *muxOptions = NULL;
+	if (memoryOutput) {
+		if (!(ofmt_ctx->pb = openMemoryIO(&finalIO, true))) {
+			logger->Debug("Failed to allocate memory output", 0);
+			closeRemux(&ifmt_ctx, &ofmt_ctx);
+			return;
+		}
+		ofmt_ctx->flags |= AVFMT_FLAG_CUSTOM_IO;
+		//a stream can't be seeked back into to write the moov at the end
+		if (finalIO.writeFn) {
+			av_dict_set(&muxOptions, "movflags", "frag_keyframe+empty_moov+default_base_moof", 0);
+		}
+	}
+	else if (!(ofmt_ctx->oformat->flags & AVFMT_NOFILE)) {
+		if ((err = avio_open(&ofmt_ctx->pb, finalFileName.c_str(), AVIO_FLAG_WRITE)) < 0) {
+			logger->Debug("Failed to open output file", err);
+			closeRemux(&ifmt_ctx, &ofmt_ctx);
+			return;
 		}
 	}
 
 	//write the header
-	if ((err = avformat_write_header(ofmt_ctx, 0)) < 0) {
-		Debug("Failed to write header to output file", err);
-		if (ifmt_ctx) {
-			avformat_close_input(&ifmt_ctx);
-		}
-		if (ofmt_ctx && !(ofmt_ctx->oformat->flags & AVFMT_NOFILE)) {
-			avio_closep(&ofmt_ctx->pb);
-		}
-		if (ofmt_ctx) {
-			avformat_free_context(ofmt_ctx);
-		}
+	err = avformat_write_header(ofmt_ctx, &muxOptions);
+	av_dict_free(&muxOptions);
+	if (err < 0) {
+		logger->Debug("Failed to write header to output file", err);
+		closeRemux(&ifmt_ctx, &ofmt_ctx);
+		return;
 	}
 
 	AVPacket videoPkt;
@@ -321,7 +516,7 @@ void VideoCapture::Remux() {
 
 		//write the packet to the output file
 		if ((err = av_interleaved_write_frame(ofmt_ctx, &videoPkt)) < 0) {
-			Debug("Failed to mux packet", err);
+			logger->Debug("Failed to mux packet", err);
 			av_packet_unref(&videoPkt);
 			break;
 		}
@@ -330,58 +525,411 @@ void VideoCapture::Remux() {
 
 	av_write_trailer(ofmt_ctx);
 
+	//close both files so the context can be used for another video
+	closeRemux(&ifmt_ctx, &ofmt_ctx);
+}
 
+void VideoCapture::closeRemux(AVFormatContext **ifmt_ctx, AVFormatContext **ofmt_ctx) {
+	if (*ifmt_ctx) {
+		AVIOContext *pb = ((*ifmt_ctx)->flags & AVFMT_FLAG_CUSTOM_IO) ? (*ifmt_ctx)->pb : NULL;
+		avformat_close_input(ifmt_ctx);
+		closeMemoryIO(&pb);
+	}
+	//the encoded stream isn't needed once it's been remuxed (or failed to)
+	tmpIO.Clear();
+	if (*ofmt_ctx) {
+		if ((*ofmt_ctx)->flags & AVFMT_FLAG_CUSTOM_IO) {
+			closeMemoryIO(&(*ofmt_ctx)->pb);
+		}
+		else if (!((*ofmt_ctx)->oformat->flags & AVFMT_NOFILE)) {
+			avio_closep(&(*ofmt_ctx)->pb);
+		}
+		avformat_free_context(*ofmt_ctx);
+		*ofmt_ctx = NULL;
+	}
 }
 
 
 
 
-//pixel struct for storing pixel data as well as position in picture
+//pixel struct for storing pixel data as well as position in picture. the sorts
+//are templated on Index, int for normal images (8 byte pixels) and long long for
+//ones too big for it (16 bytes), chosen by the size when the render starts
+template <typename Index>
 struct Pixel {
 	unsigned char r;
 	unsigned char g;
 	unsigned char b;
-	int position;
+	Index position;
+};
+
+//biggest image (in pixels) sorted with int indices, with room for the heap's 2 * index + 2
+#define PIXEL_INDEX32_MAX (INT_MAX / 4)
+
+inline bool needsWideIndex(long long pixels) {
+	return pixels > PIXEL_INDEX32_MAX;
+}
+
+//size of one Pixel for an image of that many pixels
+inline size_t pixelBytes(long long pixels) {
+	return needsWideIndex(pixels) ? sizeof(Pixel<long long>) : sizeof(Pixel<int>);
+}
+
+struct Checkpoint;
+
+//how a tiled render splits the image, see renderTiled. width and height 0 is off
+//(the image is sorted as one array), rows are width 0 x 1 and columns 1 x height 0
+struct TileOptions {
+	int width;					//0 for the image's width (whole rows)
+	int height;					//0 for the image's height (whole columns)
+	int steps;					//operations every tile does between frames, 0 for its width + height
+
+	TileOptions() {
+		width = 0;
+		height = 0;
+		steps = 0;
+	}
+
+	bool on() const {
+		return width > 0 || height > 0;
+	}
+};
+
+//everything one visualization needs while it runs, handed to every sort so
+//several renders can run side by side in one process
+struct RenderContext {
+	unsigned long long frameCount;	//operations done so far, past 4 billion for bubble sorts of big images
+	unsigned int skip;			//a frame is added every skip operations
+	char loadSign;
+	unsigned int seed;			//0 seeds the shuffles from the clock
+	unsigned int changed;		//pixels changed since the last frame
+	long long touchedFirst;		//lowest and highest pixel index written since the last frame, -1 for none
+	long long touchedLast;
+	bool quiet;					//no progress printing
+	std::mt19937 rng;
+	CaptureSink* capture;
+	Logger* logger;
+	Checkpoint* checkpoint;		//NULL when the render isn't checkpointed
+	unsigned long long replayUntil;	//a resumed render makes no frames (and prints nothing) up to this operation
+	TileOptions tiles;			//off sorts the image as one array, otherwise as tiles (or rows, or columns) side by side
+	std::string mapDir;			//non empty keeps the pixel array, the image being sorted and the scratch of extmerge and blockradix in mapped files there
+	MappedFile* pixelFile;		//the mapped pixel array and image of the render, NULL when they're in memory
+	MappedFile* imageFile;
+
+	RenderContext() {
+		frameCount = 0;
+		skip = 100;
+		loadSign = '\\';
+		seed = 0;
+		changed = 0;
+		touchedFirst = -1;
+		touchedLast = -1;
+		quiet = false;
+		capture = NULL;
+		logger = &defaultLogger();
+		checkpoint = NULL;
+		replayUntil = 0;
+		pixelFile = NULL;
+		imageFile = NULL;
+	}
+};
+
+#define DEFAULT_FPS 60
+#define DEFAULT_BITRATE 3000
+
+//an extra video encoded from the same frames, e.g. a small preview
+struct RenditionSpec {
+	std::string fileName;
+	int width;
+	int height;
+	int bitrate;
+	std::string codec;			//empty for the format's default
+};
+
+//where and how the frames of a visualization are written, see createSink
+struct SinkOptions {
+	std::string type;			//video, hash, y4m, ...
+	std::string fileName;		//empty for the type's default
+	std::string statsFile;		//per frame csv (video only), empty for none
+	int fps;
+	int bitrate;
+	int fragmentFrames;			//video only, write a playable fragmented file, flushed every N frames (0 for off)
+	int fitWidth;				//video only, scale frames down to fit fitWidth x fitHeight (0 for the image's size)
+	int fitHeight;
+	int viewWidth;				//only a viewWidth x viewHeight window following the sort goes to the sink (0 for the whole image)
+	int viewHeight;
+	int viewSmoothing;			//frames the window takes to catch up with the sort
+	YuvMatrix colorMatrix;		//video only, how the frames are converted to yuv (and the video tagged)
+	bool fullRange;
+	std::vector<RenditionSpec> renditions; //video only, encoded alongside fileName on their own threads
+
+	SinkOptions() {
+		type = "video";
+		fps = DEFAULT_FPS;
+		bitrate = DEFAULT_BITRATE;
+		fragmentFrames = 0;
+		fitWidth = 0;
+		fitHeight = 0;
+		viewWidth = 0;
+		viewHeight = 0;
+		viewSmoothing = VIEWPORT_DEFAULT_SMOOTHING;
+		colorMatrix = YUV_BT601;
+		fullRange = false;
+	}
+};
+
+#define CHECKPOINT_DEFAULT_FRAMES 3000	//frames between checkpoints, 50 s of video at 60 fps
+
+//a render that can be picked up again after a crash. every interval frames the
+//output so far is closed as a segment file (<output>.seg<n>) and the checkpoint
+//file rewritten with the pixel array as it was when the running action started
+//and the operation the last frame was made at. resuming runs that action again
+//from its start without making frames up to there (the sorts are deterministic
+//and cheap next to encoding), then carries on into a new segment. the segments
+//are joined into the output at the end and the checkpoint removed
+struct Checkpoint {
+	std::string fileName;
+	int interval;				//frames between checkpoints
+
+	//the render, so resume needs nothing else
+	std::string image;
+	std::vector<std::string> actions;
+	SinkOptions sink;
+	int width;
+	int height;
+	unsigned int seed;			//never 0, shuffles have to come out the same when they're run again
+	unsigned int skip;
+	long long maxPixels;		//what the image was shrunk to before sorting, 0 if it wasn't
+
+	//how far it got
+	int action;					//index of the running action
+	unsigned long long actionStart;	//operations done before it
+	unsigned long long operation;	//operations done at the last frame of the last segment
+	int segments;				//closed segment files
+	std::vector<uint8_t> pixels;	//the pixel array (of either index width) when the action started, empty until the first one starts
+	int framesSinceSave;
+
+	Checkpoint() {
+		interval = CHECKPOINT_DEFAULT_FRAMES;
+		width = 0;
+		height = 0;
+		seed = 0;
+		skip = 0;
+		maxPixels = 0;
+		action = 0;
+		actionStart = 0;
+		operation = 0;
+		segments = 0;
+		framesSinceSave = 0;
+	}
 };
 
 //misc functions
-Pixel* getOrderedPixelFromRBG(uint8_t*, int);
-uint8_t* getRGBFromOrderedPixel(Pixel*, int);
-void updateRGB(Pixel*, uint8_t*, int);
-void updateSingleRGB(Pixel*, uint8_t*, int);
-void printPixels(Pixel*, int);
+uint8_t* loadImage(const char*, int*, int*, Logger* logger = &defaultLogger(), const std::string& mapDir = "");
+MappedFile* imageMapping(uint8_t*);
+void freeImage(uint8_t*, long long);
+template <typename Index> Pixel<Index>* getOrderedPixelFromRBG(uint8_t*, Index);
+template <typename Index> void orderPixels(uint8_t*, Pixel<Index>*, Index);
+template <typename Index> void freePixelArray(Pixel<Index>*, Index);
+template <typename Index> uint8_t* getRGBFromOrderedPixel(Pixel<Index>*, Index);
+template <typename Index> void updateRGB(Pixel<Index>*, uint8_t*, Index);
+template <typename Index> bool updateSingleRGB(Pixel<Index>*, uint8_t*, Index);
+template <typename Index> void printPixels(Pixel<Index>*, Index);
 void printRGB(unsigned char*, int);
-void swap(Pixel*, uint8_t*, int, int, int, VideoCapture*);
-void swapNoFrame(Pixel*, uint8_t*, int, int, int);
-void delay(uint8_t*, int, VideoCapture*);
-void shufflePixels(Pixel*, uint8_t*, int, VideoCapture*);
-void shuffleNoVid(Pixel*, uint8_t*, int);
-void reverseInPlace(Pixel*, uint8_t*, int, VideoCapture*);
-int partition(Pixel*, uint8_t*, int, VideoCapture*, int, int);
-void merge(Pixel*, uint8_t*, int, int, int, int, VideoCapture*);
+template <typename Index> void swap(Pixel<Index>*, uint8_t*, Index, Index, Index, RenderContext*);
+void addFrame(uint8_t*, RenderContext*);
+template <typename Index> void touchPixel(RenderContext*, Index);
+template <typename Index> void swapNoFrame(Pixel<Index>*, uint8_t*, Index, Index, Index, RenderContext*);
+void delay(uint8_t*, int, RenderContext*);
+template <typename Index> void shufflePixels(Pixel<Index>*, uint8_t*, Index, RenderContext*);
+template <typename Index> void shuffleNoVid(Pixel<Index>*, uint8_t*, Index, RenderContext*);
+template <typename Index> void reverseInPlace(Pixel<Index>*, uint8_t*, Index, RenderContext*);
+template <typename Index> Index partition(Pixel<Index>*, uint8_t*, Index, RenderContext*, Index, Index);
+template <typename Index> void merge(Pixel<Index>*, uint8_t*, Index, Index, Index, Index, RenderContext*);
 //sorts:
 
-void quickSort(Pixel*, uint8_t*, int, VideoCapture*, int low = 0, int high = -1);
-void mergeSort(Pixel*, uint8_t*, int, VideoCapture*, int left = 0, int right = -1);
-void bubbleSort(Pixel*, uint8_t*, int, VideoCapture*);
-void heapSort(Pixel*, uint8_t*, int, VideoCapture*);
-void heapSortMin(Pixel*, uint8_t*, int, VideoCapture*);
-void countingSort(Pixel*, uint8_t*, int, VideoCapture*);
-void radixSortBaseTen(Pixel*, uint8_t*, int, VideoCapture*);
+template <typename Index> void quickSort(Pixel<Index>*, uint8_t*, Index, RenderContext*, Index low = 0, Index high = -1);
+template <typename Index> void mergeSort(Pixel<Index>*, uint8_t*, Index, RenderContext*, Index left = 0, Index right = -1);
+template <typename Index> void bubbleSort(Pixel<Index>*, uint8_t*, Index, RenderContext*);
+template <typename Index> void heapSort(Pixel<Index>*, uint8_t*, Index, RenderContext*);
+template <typename Index> void heapSortMin(Pixel<Index>*, uint8_t*, Index, RenderContext*);
+template <typename Index> void countingSort(Pixel<Index>*, uint8_t*, Index, RenderContext*);
+template <typename Index> void radixSortBaseTen(Pixel<Index>*, uint8_t*, Index, RenderContext*);
+template <typename Index> void extMergeSort(Pixel<Index>*, uint8_t*, Index, RenderContext*);
+template <typename Index> void blockRadixSort(Pixel<Index>*, uint8_t*, Index, RenderContext*);
+
+//captures:
+CaptureSink* createSink(const SinkOptions&, int, int, Logger*);
+VideoCapture* createVideo(const std::string&, const std::string&, int);
+bool parseRendition(const std::string&, RenditionSpec*);
+bool parseSize(const std::string&, int*, int*);
+bool parseMatrix(const std::string&, YuvMatrix*);
+std::string sinkFileName(const SinkOptions&);
+
+//checkpoints:
+std::string checkpointProblem(const SinkOptions&);
+bool startCheckpoint(const std::string&, int, const std::string&, const std::vector<std::string>&, const SinkOptions&, unsigned int, long long, int, int, Checkpoint*, std::string*);
+bool saveCheckpoint(const Checkpoint&);
+bool loadCheckpoint(const std::string&, Checkpoint*, std::string*);
+void checkpointRender(RenderContext*);
+template <typename Index> bool renderCheckpointed(Checkpoint*, Pixel<Index>*, uint8_t*, RenderContext*);
+int resumeRender(const char*);
+
+//actions:
+bool isValidAction(const std::string&);
+bool isValidSink(const std::string&);
+template <typename Index> void runAction(const std::string&, Pixel<Index>*, uint8_t*, Index, int, RenderContext*);
+bool renderImage(uint8_t*, int, int, const std::vector<std::string>&, const SinkOptions&, Checkpoint*, RenderContext*);
+void renderTiled(uint8_t*, int, int, const std::vector<std::string>&, const SinkOptions&, RenderContext*);
+bool parseTiles(const std::string&, TileOptions*);
+std::string tilesName(const TileOptions&);
+
+//preprocessing:
+void shrunkSize(int, int, long long, int*, int*);
+uint8_t* downsampleRGB(const uint8_t*, int, int, int, int);
+bool shrinkImage(uint8_t**, int*, int*, long long, std::string*);
+
+//reports:
+void printRunReport(RenderContext*, int, int, double);
+
+//benchmarks:
+#define BENCH_BASELINE_FILE "bench_baseline.csv"
+#define BENCH_RUNS 5
+#define BENCH_TOLERANCE 0.05		//fraction of the baseline median a run may slow down by
+#define BENCH_NOISE_MADS 3.0		//or this many (scaled) MADs, whichever is larger
+#define BENCH_BUBBLE_LIMIT 4096		//bubble sort is only timed on images with at most this many pixels
+#define BENCH_FRAMES 30
+#define BENCH_SEED 12345
+bool isValidBenchMode(const std::string&);
+int runBenchmark(uint8_t*, int, int, const std::string&, const std::string&, int);
+
+//planning:
+#define PLAN_DEFAULT_NS_PER_OPERATION 200.0	//sort cost per operation until calibrated
+#define PLAN_DEFAULT_NS_PER_PIXEL 5.0		//conversion + encode cost per pixel of a frame until calibrated
+#define PLAN_ENCODER_FRAMES 8				//yuv frames the encoder keeps (lookahead, references)
+#define PLAN_SIM_LIMIT 2000000000ULL		//comparisons before a simulated sort gives up and estimates
+//what an action list is expected to cost, before anything is sorted or encoded
+struct PlanSummary {
+	unsigned long long operations;
+	unsigned long long frames;
+	double sortSeconds;
+	double encodeSeconds;
+	double outputBytes;
+	long long peakBytes;
+	bool estimated;	//some counts are extrapolated rather than exact
+};
+
+//what sorting and encoding cost on this machine, loaded once before anything is
+//planned and only read after that, so batch workers can plan at the same time
+struct PlanCostModel {
+	double nsPerOperation;
+	double nsPerPixel;
+	bool calibrated;	//measured, not the defaults
+
+	PlanCostModel() {
+		nsPerOperation = PLAN_DEFAULT_NS_PER_OPERATION;
+		nsPerPixel = PLAN_DEFAULT_NS_PER_PIXEL;
+		calibrated = false;
+	}
+};
+
+PlanSummary planActions(const std::vector<std::string>&, int, int, int, int, unsigned int, bool, const PlanCostModel&);
+long long pixelsWithin(const std::vector<std::string>&, int, int, const SinkOptions&, unsigned int, double, const PlanCostModel&);
+long long pixelLimit(const std::vector<std::string>&, int, int, const SinkOptions&, unsigned int, long long, double, const PlanCostModel&);
+PlanCostModel loadPlanCalibration();
+void calibratePlan(uint8_t*, int, int, PlanCostModel*);
+
+//batches:
+int runBatch(const char*, int);
+
+int main(int argc, char* argv[]) {
+	//non interactive benchmark, for running as a regression gate:
+	//sorting_visualizer bench <image> [run|save|check] [commit] [runs]
+	if (argc > 1 && std::string(argv[1]) == "bench") {
+		if (argc < 3) {
+			std::cout << "usage: " << argv[0] << " bench <image> [run|save|check] [commit] [runs]" << std::endl;
+			return 2;
+		}
+		std::string mode = argc > 3 ? argv[3] : "run";
+		std::string commit = argc > 4 ? argv[4] : "local";
+		int runs = argc > 5 ? atoi(argv[5]) : BENCH_RUNS;
+		if (!isValidBenchMode(mode) || runs < 1) {
+			std::cout << ">> The mode has to be run, save or check, and runs at least 1." << std::endl;
+			return 2;
+		}
+		int benchWidth, benchHeight;
+		uint8_t* benchImage = loadImage(argv[2], &benchWidth, &benchHeight);
+		if (!benchImage) {
+			std::cout << ">> Couldn't find file." << std::endl;
+			return 2;
+		}
+		int result = runBenchmark(benchImage, benchWidth, benchHeight, mode, commit, runs);
+		freeImage(benchImage, (long long)benchWidth * benchHeight);
+		return result;
+	}
+
+	//non interactive batch of jobs, run several at a time:
+	//sorting_visualizer batch <jobfile> [workers]
+	if (argc > 1 && std::string(argv[1]) == "batch") {
+		if (argc < 3) {
+			std::cout << "usage: " << argv[0] << " batch <jobfile> [workers]" << std::endl;
+			std::cout << "each line of jobfile: <image> <output> <action>[,<action>...] [fps=N] [bitrate=N] [sink=video|hash|y4m|yuv420p|rgb24|png|qoi|gif] [seed=N] [stats=file] [fragment=N] [fit=WxH] [colors=bt601|bt709] [range=full|limited] [viewport=WxH] [viewportframes=N] [rendition=WxH:kbps:codec:file]... [checkpoint=file] [checkpointframes=N] [tile=N|rows|cols] [tilesteps=N] [map=dir] [maxpixels=N] [timebudget=S] [log=file] [loglevel=level]" << std::endl;
+			return 2;
+		}
+		return runBatch(argv[2], argc > 3 ? atoi(argv[3]) : 0);
+	}
+
+	//picks up a render that was saving checkpoints where it stopped:
+	//sorting_visualizer resume <checkpoint>
+	if (argc > 1 && std::string(argv[1]) == "resume") {
+		if (argc < 3) {
+			std::cout << "usage: " << argv[0] << " resume <checkpoint>" << std::endl;
+			return 2;
+		}
+		return resumeRender(argv[2]);
+	}
 
+	//non interactive plan, for a scheduler to vet a job before running it:
+	//sorting_visualizer plan <image> <action> [action...]
+	if (argc > 1 && std::string(argv[1]) == "plan") {
+		if (argc < 4) {
+			std::cout << "usage: " << argv[0] << " plan <image> <action> [action...]" << std::endl;
+			return 2;
+		}
+		int planWidth, planHeight, planBpp;
+		if (!ImageFile::Info(argv[2], &planWidth, &planHeight) && !stbi_info(argv[2], &planWidth, &planHeight, &planBpp)) {
+			std::cout << ">> Couldn't find file." << std::endl;
+			return 2;
+		}
+		std::vector<std::string> planList;
+		for (int i = 3; i < argc; i++) {
+			if (!isValidAction(argv[i])) {
+				std::cout << ">> Invalid action " << argv[i] << "!" << std::endl;
+				return 2;
+			}
+			planList.push_back(argv[i]);
+		}
+		planActions(planList, planWidth, planHeight, DEFAULT_FPS, DEFAULT_BITRATE, 0, true, loadPlanCalibration());
+		return 0;
+	}
 
-//global variables
-unsigned int FRAMECOUNT = 0;
-unsigned int SKIP = 100;
-char LOADSIGN = '\\';
-int main() {
 	const char *EXT = "mpeg1video";
 	char FILENAME[] = "visualized_sort.mpg";
-	int width, height, bpp;
+	int width, height;
 	const char *IMAGEFILE; //"../assets/testIMGBig.PNG"
 	uint8_t* rgb_image = NULL;
 	std::vector <std::string> actionList;
 	std::string inputStr;
+	SinkOptions sink;
+	unsigned int seed = 0;
+	std::string imageName;
+	std::string checkpointFile;
+	int checkpointFrames = CHECKPOINT_DEFAULT_FRAMES;
+	TileOptions tiles;
+	std::string mapDir;
+	long long shrinkPixels = 0;
+	double timeBudget = 0;
+	PlanCostModel planCost = loadPlanCalibration();
 	std::cout << "-------------------------------------------------------------------------------------" << std::endl;
 	std::cout << "------------------------------ Image Sorting Visualizer -----------------------------" << std::endl;
 	std::cout << "-------------------------------------------------------------------------------------" << std::endl;
@@ -402,12 +950,104 @@ int main() {
 			std::cout << "    add <action>, Usage: add an action to the visualization." << std::endl;
 			std::cout << "    clear, Usage: clears the list of actions added prior." << std::endl;
 			std::cout << "    status, Usage: view the list of actions added prior." << std::endl;
+			std::cout << "    sink <video|hash|y4m|yuv420p|rgb24|png|qoi|gif> [file], Usage: choose where frames go, video encodes file (sortingSample.mp4),\n                   hash writes a hash of every frame to file (frames.xxh64) instead of encoding,\n                   y4m, yuv420p and rgb24 write uncompressed frames to file (frames.<type>) or a named pipe,\n                   png and qoi write every frame as an image into the directory file (frames) with a manifest.csv,\n                   gif writes an animated gif to file (sortingSample.gif) with a palette made from the image." << std::endl;
+			std::cout << "    stats <file|off>, Usage: write a csv row for every encoded frame (operations, changed pixels,\n                   conversion and encode time, packet size)." << std::endl;
+			std::cout << "    fragment <frames|off>, Usage: write the video as a fragmented mp4 (or mkv) flushed every frames frames,\n                   so it can be watched while it renders and a crash leaves a playable file." << std::endl;
+			std::cout << "    fit <width>x<height>|off, Usage: encode the video scaled down to fit inside width x height (e.g. fit 1920x1080),\n                   so a big image encodes at that size. an image that's a whole multiple of it is averaged down." << std::endl;
+			std::cout << "    colors <bt601|bt709> [full|limited], Usage: the matrix and range the video is converted to yuv with\n                   and tagged with (bt601 limited)." << std::endl;
+			std::cout << "    viewport <width>x<height> [frames]|off, Usage: only show a width x height window of the image that follows\n                   the pixels the sort is writing, catching up over frames frames (30), so a big image encodes small.\n                   can't be checkpointed." << std::endl;
+			std::cout << "    rendition <width>x<height>:<kbps>:<codec|default>:<file>|clear, Usage: also encode the video at another size,\n                   bitrate or codec, from the same frames on its own thread (e.g. rendition 320x240:500:default:preview.mp4)." << std::endl;
+			std::cout << "    checkpoint <file> [frames]|off, Usage: save a checkpoint every frames frames (3000), closing the output\n                   so far as a segment. create with the same checkpoint, or sorting_visualizer resume <file>,\n                   carries on from the last one after a crash (video, hash, y4m, yuv420p and rgb24 sinks)." << std::endl;
+			std::cout << "    tile <size|rows|cols|off> [steps], Usage: sort the image as size x size tiles, or every row or column,\n                   each shuffled and sorted on its own at the same time (one per core), instead of as one array,\n                   with a frame after every tile did steps operations (its width + height). can't be checkpointed." << std::endl;
+			std::cout << "    map <dir>|off, Usage: keep the pixel array and the image being sorted in temporary files in dir, mapped into\n                   memory, for images bigger than the RAM (with extmerge or blockradix, their scratch too). not for tiles." << std::endl;
+			std::cout << "    shrink <pixels>|off, Usage: shrink the image to at most pixels pixels (averaging them) before sorting it,\n                   so the slow sorts have fewer to go through." << std::endl;
+			std::cout << "    timebudget <seconds>|off, Usage: shrink the image to what plan estimates the actions sort and encode\n                   in seconds, at create." << std::endl;
+			std::cout << "    seed <number>, Usage: make the shuffles repeatable (0 for a new shuffle every time)." << std::endl;
+			std::cout << "    loglevel <level>, Usage: how much goes to Logs.txt: quiet, error, warning, info (default), verbose or debug." << std::endl;
+			std::cout << "    budget <MB>, Usage: stop the visualization if the tracked memory goes over MB (0 for no limit)." << std::endl;
+			std::cout << "    memory, Usage: view the tracked memory use and the peak size of the process." << std::endl;
+			std::cout << "    plan [calibrate], Usage: estimate operations, frames, encode time, output size and peak memory\n                   of the actions on the loaded file, calibrate times this machine first." << std::endl;
 			std::cout << "    create, Usage: creates the visualization, as long as there is at least one action,\n                   and a valid file. (Exits upon completion)" << std::endl;
+			std::cout << "    bench [save|check] [commit], Usage: times each sort and frame encoding on the loaded file,\n                   save stores the results as the baseline, check compares against it" << std::endl;
 			std::cout << "-------------------------------------------------------------------------------------" << std::endl;
 			std::cout << "Actions:\n    Sorts: bubble, quick, merge, heapMax, heapMin, counting, radix" << std::endl;
+			std::cout << "    Out of core sorts: extmerge, blockradix (stream through the pixels, for mapped images)" << std::endl;
 			std::cout << "    Other: delay (1 second), shuffle, shuffleNoVid, reverse" << std::endl;
 		}
-		else if (inputStr.find("file") != std::string::npos) {
+		else if (inputStr.find("bench") == 0) {
+			//bench [save|check] [commit]
+			if (!rgb_image) {
+				std::cout << ">> Need a valid file." << std::endl;
+				continue;
+			}
+			std::string mode = "run";
+			std::string commit = "local";
+			std::string benchArgs = inputStr.size() > 5 ? inputStr.substr(6) : "";
+			size_t split = benchArgs.find(' ');
+			if (!benchArgs.empty()) {
+				mode = benchArgs.substr(0, split);
+				if (split != std::string::npos) {
+					commit = benchArgs.substr(split + 1);
+				}
+			}
+			if (!isValidBenchMode(mode)) {
+				std::cout << ">> Invalid mode, expected run, save or check." << std::endl;
+				continue;
+			}
+			if (runBenchmark(rgb_image, width, height, mode, commit, BENCH_RUNS) == 1) {
+				std::cout << ">> The benchmark found a regression." << std::endl;
+			}
+			//a first baseline is the cost model plan uses from now on
+			if (mode == "save" && !planCost.calibrated) {
+				planCost = loadPlanCalibration();
+			}
+		}
+		else if (inputStr.find("map") == 0) {
+			//map <dir>, or map off
+			std::string dir = inputStr.size() > 4 ? inputStr.substr(4) : "";
+			if (dir.empty()) {
+				std::cout << ">> provide a directory, or off." << std::endl;
+			}
+			else if (dir == "off") {
+				mapDir = "";
+				std::cout << ">> The pixels will be kept in memory." << std::endl;
+			}
+			else {
+				mapDir = dir;
+				std::cout << ">> The pixels will be mapped from files in " << mapDir << "." << std::endl;
+			}
+		}
+		else if (inputStr.find("shrink") == 0) {
+			//shrink <pixels>, or shrink off
+			std::string pixels = inputStr.size() > 7 ? inputStr.substr(7) : "";
+			if (pixels == "off") {
+				shrinkPixels = 0;
+				std::cout << ">> The image will be sorted at its size." << std::endl;
+			}
+			else if (atoll(pixels.c_str()) > 0) {
+				shrinkPixels = atoll(pixels.c_str());
+				std::cout << ">> The image will be shrunk to at most " << shrinkPixels << " pixels." << std::endl;
+			}
+			else {
+				std::cout << ">> provide a number of pixels, or off." << std::endl;
+			}
+		}
+		else if (inputStr.find("timebudget") == 0) {
+			//timebudget <seconds>, or timebudget off
+			std::string seconds = inputStr.size() > 11 ? inputStr.substr(11) : "";
+			if (seconds == "off") {
+				timeBudget = 0;
+				std::cout << ">> Time budget turned off." << std::endl;
+			}
+			else if (atof(seconds.c_str()) > 0) {
+				timeBudget = atof(seconds.c_str());
+				std::cout << ">> The image will be shrunk to fit " << timeBudget << " seconds." << std::endl;
+			}
+			else {
+				std::cout << ">> provide a number of seconds, or off." << std::endl;
+			}
+		}
+		else if (inputStr.find("file") == 0) {
 			//read the filename, and try to open it
 			std::string imageFileInput;
 			
@@ -419,23 +1059,28 @@ int main() {
 				std::getline(std::cin, imageFileInput);
 			}
 			IMAGEFILE = imageFileInput.c_str();
+			if (rgb_image) {
+				freeImage(rgb_image, (long long)width * height);
+				rgb_image = NULL;
+			}
 			try {
-				rgb_image = stbi_load(IMAGEFILE, &width, &height, &bpp, 3);
+				rgb_image = loadImage(IMAGEFILE, &width, &height, &defaultLogger(), mapDir);
 			}
 			catch (const std::exception& e) {
-				std::cout << ">> Couldn't read file." << std::endl;
+				std::cout << ">> Couldn't read file. (" << e.what() << ")" << std::endl;
 			}
 
 			if (!rgb_image) {
 				std::cout << ">> Couldn't find file." << std::endl;
 			}
 			else {
+				imageName = imageFileInput;
 				std::cout << ">> " << imageFileInput << " successfully loaded." << std::endl;
 			}
 
 
 		}
-		else if (inputStr.find("add") != std::string::npos) {
+		else if (inputStr.find("add") == 0) {
 			//add stuff to the actionList
 			std::string actionInput;
 			if (inputStr.size() > 3) {
@@ -446,7 +1091,7 @@ int main() {
 				std::getline(std::cin, actionInput);
 			}
 
-			if (actionInput == "bubble" || actionInput == "quick" || actionInput == "merge" || actionInput == "heapMax" || actionInput == "heapMin" || actionInput == "counting" || actionInput == "radix" || actionInput == "shuffle" || actionInput == "shuffleNoVid" || actionInput == "reverse"|| actionInput == "delay") {
+			if (isValidAction(actionInput)) {
 				actionList.push_back(actionInput);
 				std::cout << ">> " << actionInput << " successfully added." << std::endl;
 			}
@@ -470,6 +1115,180 @@ int main() {
 			}
 			std::cout << "-------------------------------------------------------------------------------------" << std::endl;
 		}
+		else if (inputStr.find("plan") == 0) {
+			if (!rgb_image) {
+				std::cout << ">> Need a valid file." << std::endl;
+			}
+			else {
+				if (inputStr == "plan calibrate") {
+					calibratePlan(rgb_image, width, height, &planCost);
+				}
+				planActions(actionList, width, height, DEFAULT_FPS, DEFAULT_BITRATE, seed, true, planCost);
+			}
+		}
+		else if (inputStr.find("sink") == 0) {
+			//sink <video|hash|y4m|yuv420p|rgb24|png|qoi|gif> [file]
+			std::string sinkArgs = inputStr.size() > 4 ? inputStr.substr(5) : "";
+			size_t split = sinkArgs.find(' ');
+			std::string type = sinkArgs.substr(0, split);
+			if (split != std::string::npos && sinkArgs.substr(split + 1) == "-") {
+				std::cout << ">> The prompt is on stdout, use a named pipe here or the batch mode for stdout." << std::endl;
+			}
+			else if (isValidSink(type)) {
+				sink.type = type;
+				sink.fileName = split != std::string::npos ? sinkArgs.substr(split + 1) : "";
+				std::cout << ">> Frames will go to " << sink.type << "." << std::endl;
+			}
+			else {
+				std::cout << ">> Invalid sink!" << std::endl;
+			}
+		}
+		else if (inputStr.find("stats") == 0) {
+			sink.statsFile = inputStr.size() > 6 ? inputStr.substr(6) : "";
+			if (sink.statsFile == "off") {
+				sink.statsFile = "";
+			}
+			std::cout << ">> Frame stats " << (sink.statsFile.empty() ? "off." : "will be written to " + sink.statsFile + ".") << std::endl;
+		}
+		else if (inputStr.find("rendition") == 0) {
+			//rendition <width>x<height>:<bitrate>:<codec|default>:<file>, or rendition clear
+			std::string spec = inputStr.size() > 10 ? inputStr.substr(10) : "";
+			RenditionSpec rendition;
+			if (spec == "clear") {
+				sink.renditions.clear();
+				std::cout << ">> Renditions cleared." << std::endl;
+			}
+			else if (parseRendition(spec, &rendition)) {
+				sink.renditions.push_back(rendition);
+				std::cout << ">> " << rendition.fileName << " will be encoded at " << rendition.width << "x" << rendition.height << " alongside the video." << std::endl;
+			}
+			else {
+				std::cout << ">> Invalid rendition, expected <width>x<height>:<bitrate>:<codec|default>:<file>." << std::endl;
+			}
+		}
+		else if (inputStr.find("colors") == 0) {
+			//colors <bt601|bt709> [full|limited]
+			std::stringstream colorArgs(inputStr.size() > 7 ? inputStr.substr(7) : "");
+			std::string matrix, range = "limited";
+			colorArgs >> matrix >> range;
+			YuvMatrix newMatrix;
+			if (!parseMatrix(matrix, &newMatrix) || (range != "full" && range != "limited")) {
+				std::cout << ">> Invalid colors, expected bt601 or bt709, then full or limited." << std::endl;
+			}
+			else {
+				sink.colorMatrix = newMatrix;
+				sink.fullRange = range == "full";
+				std::cout << ">> The video will be " << matrix << " " << range << " range." << std::endl;
+			}
+		}
+		else if (inputStr.find("fit") == 0) {
+			//fit <width>x<height>, or fit off
+			std::string size = inputStr.size() > 4 ? inputStr.substr(4) : "";
+			int fitWidth, fitHeight;
+			if (size == "off") {
+				sink.fitWidth = 0;
+				sink.fitHeight = 0;
+				std::cout << ">> The video will be the size of the image." << std::endl;
+			}
+			else if (parseSize(size, &fitWidth, &fitHeight)) {
+				sink.fitWidth = fitWidth;
+				sink.fitHeight = fitHeight;
+				std::cout << ">> The video will fit inside " << fitWidth << "x" << fitHeight << "." << std::endl;
+			}
+			else {
+				std::cout << ">> Invalid size, expected <width>x<height> or off." << std::endl;
+			}
+		}
+		else if (inputStr.find("viewport") == 0) {
+			//viewport <width>x<height> [frames], or viewport off
+			std::stringstream viewArgs(inputStr.size() > 9 ? inputStr.substr(9) : "");
+			std::string size;
+			int smoothing = VIEWPORT_DEFAULT_SMOOTHING;
+			int viewWidth, viewHeight;
+			viewArgs >> size >> smoothing;
+			if (size == "off") {
+				sink.viewWidth = 0;
+				sink.viewHeight = 0;
+				std::cout << ">> The whole image will be shown." << std::endl;
+			}
+			else if (parseSize(size, &viewWidth, &viewHeight) && smoothing > 0) {
+				sink.viewWidth = viewWidth;
+				sink.viewHeight = viewHeight;
+				sink.viewSmoothing = smoothing;
+				std::cout << ">> A " << viewWidth << "x" << viewHeight << " window will follow the sort." << std::endl;
+			}
+			else {
+				std::cout << ">> Invalid viewport, expected <width>x<height> [frames] or off." << std::endl;
+			}
+		}
+		else if (inputStr.find("fragment") == 0) {
+			sink.fragmentFrames = inputStr.size() > 9 ? atoi(inputStr.substr(9).c_str()) : 0;
+			if (sink.fragmentFrames > 0) {
+				std::cout << ">> The video will be fragmented, playable while it renders, flushed every " << sink.fragmentFrames << " frames." << std::endl;
+			}
+			else {
+				sink.fragmentFrames = 0;
+				std::cout << ">> The video will be written after the render." << std::endl;
+			}
+		}
+		else if (inputStr.find("checkpoint") == 0) {
+			//checkpoint <file> [frames], or checkpoint off
+			std::stringstream checkpointArgs(inputStr.size() > 11 ? inputStr.substr(11) : "");
+			std::string file;
+			int frames = CHECKPOINT_DEFAULT_FRAMES;
+			checkpointArgs >> file >> frames;
+			if (file.empty() || file == "off") {
+				checkpointFile = "";
+				std::cout << ">> Checkpoints off." << std::endl;
+			}
+			else {
+				checkpointFile = file;
+				checkpointFrames = frames > 0 ? frames : CHECKPOINT_DEFAULT_FRAMES;
+				std::cout << ">> A checkpoint will be saved to " << checkpointFile << " every " << checkpointFrames << " frames." << std::endl;
+			}
+		}
+		else if (inputStr.find("tile") == 0) {
+			//tile <size|rows|cols|off> [steps]
+			std::stringstream tileArgs(inputStr.size() > 5 ? inputStr.substr(5) : "");
+			std::string layout;
+			TileOptions newTiles;
+			tileArgs >> layout >> newTiles.steps;
+			if (!parseTiles(layout, &newTiles) || newTiles.steps < 0) {
+				std::cout << ">> Invalid tiles, expected a size, rows, cols or off." << std::endl;
+			}
+			else {
+				tiles = newTiles;
+				std::cout << ">> The image will be sorted as " << tilesName(tiles) << "." << std::endl;
+			}
+		}
+		else if (inputStr.find("seed") == 0) {
+			seed = inputStr.size() > 5 ? strtoul(inputStr.substr(5).c_str(), NULL, 10) : 0;
+			std::cout << ">> Seed set to " << seed << "." << std::endl;
+		}
+		else if (inputStr.find("loglevel") == 0) {
+			int level = logLevelFromName(inputStr.size() > 9 ? inputStr.substr(9) : "");
+			if (level == -1) {
+				std::cout << ">> Log level must be quiet, error, warning, info, verbose or debug." << std::endl;
+			}
+			else {
+				defaultLogger().SetLevel(level);
+				std::cout << ">> Log level set." << std::endl;
+			}
+		}
+		else if (inputStr.find("budget") == 0) {
+			if (inputStr.size() > 7) {
+				memoryStats().budget = atoll(inputStr.substr(7).c_str()) * 1048576;
+				std::cout << ">> Memory budget set." << std::endl;
+			}
+			else {
+				std::cout << ">> provide a budget in MB." << std::endl;
+			}
+		}
+		else if (inputStr == "memory") {
+			std::cout << "-------------------------------------------------------------------------------------" << std::endl;
+			printMemoryReport();
+			std::cout << "-------------------------------------------------------------------------------------" << std::endl;
+		}
 		else if (inputStr == "clear") {
 			actionList.clear();
 			std::cout << ">> Actions cleared." << std::endl;
@@ -482,55 +1301,45 @@ int main() {
 				std::cout << ">> Need a valid file." << std::endl;
 			}
 			else {
-				int size = width * height;
-				int fps, bitrate;
-				fps = 60; //480 by default
-				bitrate = 3000;
-				SKIP = width + height;
-				Pixel* pixelArray = getOrderedPixelFromRBG(rgb_image, size);
-				VideoCapture *capture = Init(width, height, fps, bitrate);
-
-				for (int i = 0; i < actionList.size(); i++) {
-					if (actionList[i] == "bubble") {
-						SKIP *= 5;
-						bubbleSort(pixelArray, rgb_image, size, capture);
-						SKIP = SKIP / 5;
-					}
-					else if(actionList[i] == "quick") {
-						quickSort(pixelArray, rgb_image, size, capture);
-					}
-					else if (actionList[i] == "merge") {
-						mergeSort(pixelArray, rgb_image, size, capture);
-					}
-					else if (actionList[i] == "heapMax") {
-						heapSort(pixelArray, rgb_image, size, capture);
-					}
-					else if (actionList[i] == "heapMin") {
-						heapSortMin(pixelArray, rgb_image, size, capture);
-					}
-					else if (actionList[i] == "counting") {
-						countingSort(pixelArray, rgb_image, size, capture);
-					}
-					else if (actionList[i] == "radix") {
-						radixSortBaseTen(pixelArray, rgb_image, size, capture);
-					}
-					else if (actionList[i] == "shuffle") {
-						shufflePixels(pixelArray, rgb_image, size, capture);
-					}
-					else if (actionList[i] == "shuffleNoVid") {
-						shuffleNoVid(pixelArray, rgb_image, size);
-					}
-					else if (actionList[i] == "reverse") {
-						reverseInPlace(pixelArray, rgb_image, size, capture);
-					}
-					else if (actionList[i] == "delay") {
-						delay(rgb_image, fps, capture);
+				RenderContext ctx;
+				ctx.seed = seed;
+				ctx.tiles = tiles;
+				ctx.mapDir = mapDir;
+				Checkpoint checkpoint;
+				std::string checkpointError;
+				if (tiles.on() && !checkpointFile.empty()) {
+					std::cout << ">> Tiled renders can't be checkpointed, turn one of them off." << std::endl;
+					continue;
+				}
+				if (tiles.on() && !mapDir.empty()) {
+					std::cout << ">> Tiled renders aren't mapped, turn one of them off." << std::endl;
+					continue;
+				}
+				long long maxPixels = pixelLimit(actionList, width, height, sink, seed, shrinkPixels, timeBudget, planCost);
+				std::string shrunk;
+				if (shrinkImage(&rgb_image, &width, &height, maxPixels, &shrunk)) {
+					std::cout << ">> " << imageName << " " << shrunk << "." << std::endl;
+				}
+				ctx.skip = width + height;
+				if (!checkpointFile.empty() && !startCheckpoint(checkpointFile, checkpointFrames, imageName, actionList, sink, seed, maxPixels, width, height, &checkpoint, &checkpointError)) {
+					std::cout << ">> " << checkpointError << "." << std::endl;
+					continue;
+				}
+				std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+				try {
+					if (!renderImage(rgb_image, width, height, actionList, sink, checkpointFile.empty() ? NULL : &checkpoint, &ctx)) {
+						std::cout << std::endl << ">> Couldn't join the segments, see Logs.txt." << std::endl;
 					}
+					delete ctx.capture;
+				}
+				catch (const std::exception& e) {
+					std::cout << std::endl << ">> Stopped: " << e.what() << std::endl;
+					printRunReport(&ctx, width, height, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+					return 1;
 				}
-				capture->Finish();
-				stbi_image_free(rgb_image);
-				delete[] pixelArray;
-				pixelArray = NULL;
+				std::cout << std::endl;
+				printRunReport(&ctx, width, height, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+				freeImage(rgb_image, (long long)width * height);
 				return 0;
 			}
 		}
@@ -549,95 +1358,720 @@ int main() {
 /*--------------------------------------------------------------------------------------------------------------------------------------------------*/
 
 
-/*----------------------------------------------------------UPDATE FUNCTIONS-------------------------------------------------------*/
-Pixel* getOrderedPixelFromRBG(uint8_t* rgb ,int size) {
-	Pixel* newArray;
-	newArray = new Pixel[size];
-	//width & height are amount of pixels, not amount of elements
-	//thus there are 3*width*height actual elements in the rgb array
-	for (int i = 0; i < size; i++) {
-		newArray[i] = Pixel();
-		newArray[i].r = rgb[3 * i];
-		newArray[i].g = rgb[3 * i + 1];
-		newArray[i].b = rgb[3 * i + 2];
-		newArray[i].position = i;
+/*----------------------------------------------------------CAPTURES---------------------------------------------------------------*/
+//makes the capture chosen with the sink command, ready for frames,
+//fileName is where its output goes (empty for the default name)
+CaptureSink* createSink(const SinkOptions& options, int width, int height, Logger* logger) {
+	const std::string& type = options.type;
+	const std::string& fileName = options.fileName;
+	CaptureSink* capture;
+	if (type == "hash") {
+		capture = new HashCapture(sinkFileName(options));
 	}
-	return newArray;
+	else if (type == "y4m" || type == "yuv420p" || type == "rgb24") {
+		capture = new RawCapture(type, sinkFileName(options));
+	}
+	else if (type == "gif") {
+		capture = new GifCapture(sinkFileName(options));
+	}
+	else if (type == "png" || type == "qoi") {
+		capture = new SequenceCapture(type, sinkFileName(options));
+	}
+	else {
+		VideoCapture* video = createVideo(fileName, "", options.fragmentFrames);
+		video->SetOutputSize(options.fitWidth, options.fitHeight);
+		video->SetColors(options.colorMatrix, options.fullRange);
+		if (!options.statsFile.empty() && !video->EnableStats(options.statsFile)) {
+			std::cout << ">> Couldn't open " << options.statsFile << " for frame stats." << std::endl;
+		}
+		capture = video;
+		//the renditions get the same frames, each encoded on its own thread
+		if (!options.renditions.empty()) {
+			MultiCapture* multi = new MultiCapture();
+			multi->Add(video);
+			for (size_t i = 0; i < options.renditions.size(); i++) {
+				const RenditionSpec& spec = options.renditions[i];
+				VideoCapture* rendition = createVideo(spec.fileName, spec.codec, options.fragmentFrames);
+				rendition->SetRendition(spec.width, spec.height, spec.codec);
+				rendition->SetColors(options.colorMatrix, options.fullRange);
+				multi->Add(rendition, spec.bitrate);
+			}
+			capture = multi;
+		}
+	}
+	if (options.viewWidth > 0 && options.viewHeight > 0) {
+		capture = new ViewportCapture(capture, options.viewWidth, options.viewHeight, options.viewSmoothing);
+	}
+	capture->SetLogger(logger);
+	capture->Init(width, height, options.fps, options.bitrate);
+	return capture;
 }
 
-uint8_t* getRGBFromOrderedPixel(Pixel* pixelArr, int size){
-	unsigned char* newArray;
-	newArray = new unsigned char[size * 3];
-	for (int i = 0; i < size; i++) {
-		newArray[i * 3] = pixelArr[i].r;
-		newArray[i * 3+1] = pixelArr[i].g;
-		newArray[i * 3+2] = pixelArr[i].b;
+//a video capture writing fileName (the default file if empty)
+VideoCapture* createVideo(const std::string& fileName, const std::string& codec, int fragmentFrames) {
+	VideoCapture* video = new VideoCapture();
+	if (!fileName.empty()) {
+		//the raw tmp stream only holds h264, mkv takes anything else
+		bool h264 = codec.empty() || codec.find("264") != std::string::npos;
+		video->SetOutput(fileName + (h264 ? ".tmp.h264" : ".tmp.mkv"), fileName);
 	}
-	return newArray;
+	if (fragmentFrames > 0) {
+		video->SetFragmented(fragmentFrames);
+	}
+	return video;
 }
 
+//where the sink's output goes, its default if no file was given
+std::string sinkFileName(const SinkOptions& options) {
+	if (!options.fileName.empty()) {
+		return options.fileName;
+	}
+	if (options.type == "hash") {
+		return "frames.xxh64";
+	}
+	if (options.type == "y4m" || options.type == "yuv420p" || options.type == "rgb24") {
+		return "frames." + options.type;
+	}
+	if (options.type == "png" || options.type == "qoi") {
+		return "frames";
+	}
+	return options.type == "gif" ? "sortingSample.gif" : "sortingSample.mp4";
+}
 
-/*----------------------------------------------------------UPDATE FUNCTIONS-------------------------------------------------------*/
-inline void updateVisual() {
-	switch (FRAMECOUNT % 1000) {
-	case 0: LOADSIGN = '\\';
-		break;
-	case 250: LOADSIGN = '|';
-		break;
-	case 500: LOADSIGN = '/';
-		break;
-	case 750: LOADSIGN = '-';
-		break;
+//<width>x<height>:<bitrate>:<codec|default>:<file>, e.g. 320x240:500:default:preview.mp4
+bool parseRendition(const std::string& text, RenditionSpec* spec) {
+	std::stringstream specStream(text);
+	std::string size, bitrate, codec;
+	if (!std::getline(specStream, size, ':') || !std::getline(specStream, bitrate, ':') || !std::getline(specStream, codec, ':') || !std::getline(specStream, spec->fileName)) {
+		return false;
+	}
+	if (!parseSize(size, &spec->width, &spec->height)) {
+		return false;
+	}
+	spec->bitrate = atoi(bitrate.c_str());
+	spec->codec = codec == "default" ? "" : codec;
+	return spec->bitrate > 0 && !spec->fileName.empty();
+}
+
+//<width>x<height>, both at least 2
+bool parseSize(const std::string& text, int* width, int* height) {
+	return sscanf(text.c_str(), "%dx%d", width, height) == 2 && *width >= 2 && *height >= 2;
+}
+
+//bt601 or bt709
+bool parseMatrix(const std::string& text, YuvMatrix* matrix) {
+	if (text == "bt601" || text == "bt709") {
+		*matrix = text == "bt709" ? YUV_BT709 : YUV_BT601;
+		return true;
+	}
+	return false;
+}
+
+bool isValidSink(const std::string& type) {
+	return type == "video" || type == "hash" || type == "y4m" || type == "yuv420p" || type == "rgb24" || type == "png" || type == "qoi" || type == "gif";
+}
+
+
+/*----------------------------------------------------------ACTIONS----------------------------------------------------------------*/
+bool isValidAction(const std::string& action) {
+	return action == "bubble" || action == "quick" || action == "merge" || action == "heapMax" || action == "heapMin" || action == "counting" || action == "radix" || action == "extmerge" || action == "blockradix" || action == "shuffle" || action == "shuffleNoVid" || action == "reverse" || action == "delay";
+}
+
+//how an action goes through the pixel array, for the read ahead of a mapped render
+MapAdvice actionAdvice(const std::string& action) {
+	if (action == "shuffle" || action == "shuffleNoVid" || action == "heapMax" || action == "heapMin" || action == "counting" || action == "radix") {
+		return MAP_ADVICE_RANDOM;
+	}
+	if (action == "bubble" || action == "merge" || action == "extmerge" || action == "blockradix") {
+		return MAP_ADVICE_SEQUENTIAL;
+	}
+	return MAP_ADVICE_NORMAL;
+}
+
+//runs one entry of the action list on the pixel array
+template <typename Index>
+void runAction(const std::string& action, Pixel<Index>* pixelArray, uint8_t* rgb_image, Index size, int fps, RenderContext* ctx) {
+	if (ctx->pixelFile) {
+		ctx->pixelFile->Advise(actionAdvice(action));
+		ctx->imageFile->Advise(actionAdvice(action));
+	}
+	if (action == "bubble") {
+		ctx->skip *= 5;
+		bubbleSort(pixelArray, rgb_image, size, ctx);
+		ctx->skip = ctx->skip / 5;
+	}
+	else if (action == "quick") {
+		quickSort(pixelArray, rgb_image, size, ctx);
+	}
+	else if (action == "merge") {
+		mergeSort(pixelArray, rgb_image, size, ctx);
+	}
+	else if (action == "heapMax") {
+		heapSort(pixelArray, rgb_image, size, ctx);
+	}
+	else if (action == "heapMin") {
+		heapSortMin(pixelArray, rgb_image, size, ctx);
+	}
+	else if (action == "counting") {
+		countingSort(pixelArray, rgb_image, size, ctx);
+	}
+	else if (action == "radix") {
+		radixSortBaseTen(pixelArray, rgb_image, size, ctx);
+	}
+	else if (action == "extmerge") {
+		extMergeSort(pixelArray, rgb_image, size, ctx);
+	}
+	else if (action == "blockradix") {
+		blockRadixSort(pixelArray, rgb_image, size, ctx);
+	}
+	else if (action == "shuffle") {
+		shufflePixels(pixelArray, rgb_image, size, ctx);
+	}
+	else if (action == "shuffleNoVid") {
+		shuffleNoVid(pixelArray, rgb_image, size, ctx);
+	}
+	else if (action == "reverse") {
+		reverseInPlace(pixelArray, rgb_image, size, ctx);
+	}
+	else if (action == "delay") {
+		delay(rgb_image, fps, ctx);
+	}
+}
+
+//runs the actions on the image into the sink, or the checkpoint's segments if cp isn't
+//NULL, with Index wide positions. false if the segments couldn't be joined
+template <typename Index>
+bool renderPixels(uint8_t* rgb, int width, int height, const std::vector<std::string>& actions, const SinkOptions& sink, Checkpoint* cp, RenderContext* ctx) {
+	Index size = (Index)width * height;
+	//a mapped render sorts the image where it was loaded if that's a mapped file, or a
+	//copy of it in one, the pixel array goes to a file next to it
+	MappedFile pixelFile, imageFile;
+	Pixel<Index>* pixelArray;
+	if (!ctx->mapDir.empty()) {
+		MappedFile* mapping = imageMapping(rgb);
+		if (!pixelFile.Open(ctx->mapDir, "pixels", (size_t)size * sizeof(Pixel<Index>)) || (!mapping && !imageFile.Open(ctx->mapDir, "image", (size_t)size * 3))) {
+			throw std::runtime_error("couldn't map the pixels in " + ctx->mapDir);
+		}
+		if (!mapping) {
+			imageFile.Advise(MAP_ADVICE_SEQUENTIAL);
+			memcpy(imageFile.Data(), rgb, (size_t)size * 3);
+			rgb = imageFile.Data();
+			mapping = &imageFile;
+		}
+		pixelFile.Advise(MAP_ADVICE_SEQUENTIAL);
+		mapping->Advise(MAP_ADVICE_SEQUENTIAL);
+		pixelArray = (Pixel<Index>*)pixelFile.Data();
+		orderPixels(rgb, pixelArray, size);
+		ctx->pixelFile = &pixelFile;
+		ctx->imageFile = mapping;
+	}
+	else {
+		pixelArray = getOrderedPixelFromRBG(rgb, size);
+	}
+	bool ok = true;
+	try {
+		if (cp) {
+			ok = renderCheckpointed(cp, pixelArray, rgb, ctx);
+		}
+		else {
+			ctx->capture = createSink(sink, width, height, ctx->logger);
+			for (size_t i = 0; i < actions.size(); i++) {
+				runAction(actions[i], pixelArray, rgb, size, sink.fps, ctx);
+			}
+			ctx->capture->Finish();
+		}
+	}
+	catch (...) {
+		ctx->pixelFile = NULL;
+		ctx->imageFile = NULL;
+		if (!pixelFile.Data()) {
+			freePixelArray(pixelArray, size);
+		}
+		throw;
+	}
+	ctx->pixelFile = NULL;
+	ctx->imageFile = NULL;
+	if (!pixelFile.Data()) {
+		freePixelArray(pixelArray, size);
+	}
+	return ok;
+}
+
+//renderPixels with int indices, or long long ones if the image is too big for them,
+//or renderTiled if the context has tiles (never checkpointed)
+bool renderImage(uint8_t* rgb, int width, int height, const std::vector<std::string>& actions, const SinkOptions& sink, Checkpoint* cp, RenderContext* ctx) {
+	if (ctx->tiles.on()) {
+		renderTiled(rgb, width, height, actions, sink, ctx);
+		return true;
+	}
+	if (needsWideIndex((long long)width * height)) {
+		return renderPixels<long long>(rgb, width, height, actions, sink, cp, ctx);
+	}
+	return renderPixels<int>(rgb, width, height, actions, sink, cp, ctx);
+}
+
+//runs the actions on every tile (or row, or column) of the image at once, each with its own
+//pixel array and render context (seeded from the render's seed and the tile's number), on a
+//thread per tile with one sorting per core. frames are composed from all of them by TiledCapture
+void renderTiled(uint8_t* rgb, int width, int height, const std::vector<std::string>& actions, const SinkOptions& sink, RenderContext* ctx) {
+	int tileWidth = ctx->tiles.width > 0 ? std::min(ctx->tiles.width, width) : width;
+	int tileHeight = ctx->tiles.height > 0 ? std::min(ctx->tiles.height, height) : height;
+	long long tileCount = (long long)((width + tileWidth - 1) / tileWidth) * ((height + tileHeight - 1) / tileHeight);
+	if (tileCount > TILED_MAX_TILES) {
+		throw std::runtime_error(tilesName(ctx->tiles) + " make " + std::to_string(tileCount) + " tiles, more than " + std::to_string(TILED_MAX_TILES) + ", use bigger tiles");
+	}
+	if (needsWideIndex((long long)tileWidth * tileHeight)) {
+		throw std::runtime_error(tilesName(ctx->tiles) + " are too big to sort, use smaller tiles");
+	}
+
+	ctx->capture = createSink(sink, width, height, ctx->logger);
+	TiledCapture tiles(ctx->capture, rgb, width, height, tileWidth, tileHeight, std::max(1u, std::thread::hardware_concurrency()));
+	//every tile is shuffled differently, but the same way every time for a seed
+	unsigned int seed = ctx->seed ? ctx->seed : (unsigned int)time(0);
+	std::vector<RenderContext> tileCtx(tiles.Tiles());
+	for (int i = 0; i < tiles.Tiles(); i++) {
+		tileCtx[i].skip = ctx->tiles.steps > 0 ? ctx->tiles.steps : tiles.TileWidth(i) + tiles.TileHeight(i);
+		tileCtx[i].seed = seed + i * 2654435761u;
+		tileCtx[i].seed = tileCtx[i].seed ? tileCtx[i].seed : 1;
+		tileCtx[i].quiet = true;
+		tileCtx[i].capture = tiles.Capture(i);
+		tileCtx[i].logger = ctx->logger;
+	}
+
+	try {
+		tiles.Run([&](int tile) {
+			int size = tiles.TileWidth(tile) * tiles.TileHeight(tile);
+			uint8_t* tileRGB = tiles.TileRGB(tile);
+			Pixel<int>* pixelArray = getOrderedPixelFromRBG(tileRGB, size);
+			try {
+				for (size_t i = 0; i < actions.size(); i++) {
+					runAction(actions[i], pixelArray, tileRGB, size, sink.fps, &tileCtx[tile]);
+				}
+			}
+			catch (...) {
+				freePixelArray(pixelArray, size);
+				throw;
+			}
+			freePixelArray(pixelArray, size);
+		}, [ctx](unsigned long long frames, int sorting) {
+			if (!ctx->quiet) {
+				std::cout << "\rGenerating Video, Frame: " << frames << ", tiles sorting: " << sorting << "    \r";
+			}
+		});
+	}
+	catch (...) {
+		for (size_t i = 0; i < tileCtx.size(); i++) {
+			ctx->frameCount += tileCtx[i].frameCount;
+		}
+		throw;
+	}
+	for (size_t i = 0; i < tileCtx.size(); i++) {
+		ctx->frameCount += tileCtx[i].frameCount;
+	}
+	ctx->capture->Finish();
+}
+
+//<size>, rows, cols or off, leaves the steps alone
+bool parseTiles(const std::string& text, TileOptions* tiles) {
+	if (text == "rows") {
+		tiles->width = 0;
+		tiles->height = 1;
+	}
+	else if (text == "cols") {
+		tiles->width = 1;
+		tiles->height = 0;
+	}
+	else if (text == "off") {
+		tiles->width = 0;
+		tiles->height = 0;
+	}
+	else {
+		tiles->width = tiles->height = atoi(text.c_str());
+		return tiles->width > 0;
+	}
+	return true;
+}
+
+//what the image is sorted as, for messages
+std::string tilesName(const TileOptions& tiles) {
+	if (!tiles.on()) {
+		return "one array";
+	}
+	std::string name = tiles.width == 0 ? "rows" : tiles.height == 0 ? "columns" : std::to_string(tiles.width) + "x" + std::to_string(tiles.height) + " tiles";
+	return tiles.steps > 0 ? name + " (a frame every " + std::to_string(tiles.steps) + " operations)" : name;
+}
+
+
+/*----------------------------------------------------------UPDATE FUNCTIONS-------------------------------------------------------*/
+//loads the image as rgb (3 elements per pixel), NULL if it couldn't be read
+//the images ImageFile read, by their pixels, so freeImage knows they aren't stb_image's
+std::mutex imageFilesMutex;
+std::map<uint8_t*, ImageFile*> imageFiles;
+
+//uncompressed images are mapped (or converted a row at a time, into a mapped file in
+//mapDir if it's given) by ImageFile, the rest decoded by stb_image. either way the
+//pixels come out as 8 bit rgb, what that cost (alpha, 16 bit samples) is logged as a warning
+uint8_t* loadImage(const char* fileName, int* width, int* height, Logger* logger, const std::string& mapDir) {
+	std::string conversion;
+	uint8_t* rgb;
+	ImageFile* imageFile = new ImageFile();
+	try {
+		if (!imageFile->Open(fileName, mapDir)) {
+			delete imageFile;
+			imageFile = NULL;
+		}
+	}
+	catch (...) {
+		delete imageFile;
+		throw;
+	}
+
+	if (imageFile) {
+		*width = imageFile->Width();
+		*height = imageFile->Height();
+		conversion = imageFile->Conversion();
+		rgb = imageFile->RGB();
+		std::lock_guard<std::mutex> lock(imageFilesMutex);
+		imageFiles[rgb] = imageFile;
+	}
+	else {
+		//stb_image keeps its failure reason in a global, so batch jobs load one at a time
+		static std::mutex loadMutex;
+		int channels;
+		{
+			std::lock_guard<std::mutex> lock(loadMutex);
+			if (stbi_is_16_bit(fileName)) {
+				conversion = "16 bit samples reduced to 8 bits";
+			}
+			if (stbi_info(fileName, width, height, &channels) && (channels == 2 || channels == 4)) {
+				conversion += std::string(conversion.empty() ? "" : ", ") + "alpha channel dropped";
+			}
+			rgb = stbi_load(fileName, width, height, &channels, 3);
+		}
+		if (!rgb) {
+			return NULL;
+		}
+		try {
+			trackAlloc(MEM_IMAGE, (long long)*width * *height * 3);
+		}
+		catch (...) {
+			stbi_image_free(rgb);
+			throw;
+		}
+	}
+	if (!conversion.empty() && logger->Enabled(AV_LOG_WARNING)) {
+		logger->Log(std::string(fileName) + ": " + conversion + "\n");
+	}
+	return rgb;
+}
+
+//the mapped file the pixels of a loaded image are in, NULL if they're in memory
+MappedFile* imageMapping(uint8_t* rgb) {
+	std::lock_guard<std::mutex> lock(imageFilesMutex);
+	std::map<uint8_t*, ImageFile*>::iterator found = imageFiles.find(rgb);
+	return found != imageFiles.end() ? found->second->Mapping() : NULL;
+}
+
+void freeImage(uint8_t* rgb, long long size) {
+	ImageFile* imageFile = NULL;
+	{
+		std::lock_guard<std::mutex> lock(imageFilesMutex);
+		std::map<uint8_t*, ImageFile*>::iterator found = imageFiles.find(rgb);
+		if (found != imageFiles.end()) {
+			imageFile = found->second;
+			imageFiles.erase(found);
+		}
+	}
+	if (imageFile) {
+		delete imageFile;
+		return;
+	}
+	trackFree(MEM_IMAGE, (long long)size * 3);
+	stbi_image_free(rgb);
+}
+
+/*----------------------------------------------------------PIXEL KERNELS----------------------------------------------------------*/
+//the loops between the rgb image and the pixel array, which go over every pixel
+//of the image. for normal images (Pixel<int>, 8 bytes: r, g, b, a zero byte and
+//the position) there are SSSE3 and AVX2 versions, picked by what the cpu has,
+//wide images take the scalar loop. big images are split into bands on threads
+#define KERNEL_BAND_PIXELS (1 << 20)	//pixels per thread, smaller images aren't worth starting threads for
+#define KERNEL_BENCH_PASSES 20			//passes over the image per timed run of bench
+
+static_assert(sizeof(Pixel<int>) == 8 && offsetof(Pixel<int>, position) == 4, "the SIMD kernels expect 8 byte pixels with the position at 4");
+
+//work(first, count) over 0 .. size, on one thread per band of the image
+template <typename Index, typename Work>
+void forPixelBands(Index size, const Work& work) {
+	if (size < 2 * KERNEL_BAND_PIXELS) {
+		work((Index)0, size);
+		return;
+	}
+	long long bands = std::min((long long)std::max(1u, std::thread::hardware_concurrency()), ((long long)size + KERNEL_BAND_PIXELS - 1) / KERNEL_BAND_PIXELS);
+	if (bands <= 1) {
+		work((Index)0, size);
+		return;
+	}
+	Index band = (Index)((size + bands - 1) / bands);
+	std::vector<std::thread> threads;
+	for (Index first = 0; first < size; first += band) {
+		Index count = std::min(band, size - first);
+		threads.push_back(std::thread([&work, first, count]() { work(first, count); }));
+	}
+	for (size_t i = 0; i < threads.size(); i++) {
+		threads[i].join();
+	}
+}
+
+//count pixels of rgb into pixels, at positions first, first + 1, ...
+template <typename Index>
+void packPixels(const uint8_t* rgb, Pixel<Index>* pixels, Index first, Index count) {
+	for (Index i = 0; i < count; i++) {
+		pixels[i] = Pixel<Index>();
+		pixels[i].r = rgb[3 * i];
+		pixels[i].g = rgb[3 * i + 1];
+		pixels[i].b = rgb[3 * i + 2];
+		pixels[i].position = first + i;
+	}
+}
+
+//the colors of count pixels into rgb
+template <typename Index>
+void unpackPixels(const Pixel<Index>* pixels, uint8_t* rgb, Index count) {
+	for (Index i = 0; i < count; i++) {
+		rgb[3 * i] = pixels[i].r;
+		rgb[3 * i + 1] = pixels[i].g;
+		rgb[3 * i + 2] = pixels[i].b;
+	}
+}
+
+#ifdef SIMD_X86
+//4 pixels a step from 16 bytes of rgb, so it stops 6 pixels before the end
+SIMD_TARGET("ssse3")
+int packPixelsSSSE3(const uint8_t* rgb, Pixel<int>* pixels, int first, int count) {
+	//every rgb triplet into its own 4 bytes, the fourth zeroed
+	const __m128i spread = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+	__m128i positions = _mm_setr_epi32(first, first + 1, first + 2, first + 3);
+	const __m128i step = _mm_set1_epi32(4);
+	int i = 0;
+	for (; i + 6 <= count; i += 4) {
+		__m128i colors = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(rgb + 3 * i)), spread);
+		_mm_storeu_si128((__m128i*)(pixels + i), _mm_unpacklo_epi32(colors, positions));
+		_mm_storeu_si128((__m128i*)(pixels + i + 2), _mm_unpackhi_epi32(colors, positions));
+		positions = _mm_add_epi32(positions, step);
+	}
+	return i;
+}
+
+//8 pixels a step from exactly 24 bytes of rgb
+SIMD_TARGET("avx2")
+int packPixelsAVX2(const uint8_t* rgb, Pixel<int>* pixels, int first, int count) {
+	//bytes 0 .. 11 to the low lane and 12 .. 23 to the high one, then spread like SSSE3
+	const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 0, 3, 4, 5, 0);
+	const __m256i spread = _mm256_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1,
+		0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+	__m256i positions = _mm256_setr_epi32(first, first + 1, first + 2, first + 3, first + 4, first + 5, first + 6, first + 7);
+	const __m256i step = _mm256_set1_epi32(8);
+	int i = 0;
+	for (; i + 8 <= count; i += 8) {
+		__m128i low = _mm_loadu_si128((const __m128i*)(rgb + 3 * i));
+		__m128i high = _mm_loadl_epi64((const __m128i*)(rgb + 3 * i + 16));
+		__m256i bytes = _mm256_inserti128_si256(_mm256_castsi128_si256(low), high, 1);
+		__m256i colors = _mm256_shuffle_epi8(_mm256_permutevar8x32_epi32(bytes, lanes), spread);
+		//pixels 0, 1 | 4, 5 and 2, 3 | 6, 7
+		__m256i even = _mm256_unpacklo_epi32(colors, positions);
+		__m256i odd = _mm256_unpackhi_epi32(colors, positions);
+		_mm256_storeu_si256((__m256i*)(pixels + i), _mm256_permute2x128_si256(even, odd, 0x20));
+		_mm256_storeu_si256((__m256i*)(pixels + i + 4), _mm256_permute2x128_si256(even, odd, 0x31));
+		positions = _mm256_add_epi32(positions, step);
+	}
+	return i;
+}
+
+//4 pixels a step to 12 bytes of rgb
+SIMD_TARGET("ssse3")
+int unpackPixelsSSSE3(const Pixel<int>* pixels, uint8_t* rgb, int count) {
+	const __m128i firstPair = _mm_setr_epi8(0, 1, 2, 8, 9, 10, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+	const __m128i secondPair = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, 0, 1, 2, 8, 9, 10, -1, -1, -1, -1);
+	int i = 0;
+	for (; i + 4 <= count; i += 4) {
+		__m128i colors = _mm_or_si128(_mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(pixels + i)), firstPair),
+			_mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(pixels + i + 2)), secondPair));
+		_mm_storel_epi64((__m128i*)(rgb + 3 * i), colors);
+		int last = _mm_cvtsi128_si32(_mm_srli_si128(colors, 8));
+		memcpy(rgb + 3 * i + 8, &last, 4);
+	}
+	return i;
+}
+
+//8 pixels a step to 24 bytes of rgb
+SIMD_TARGET("avx2")
+int unpackPixelsAVX2(const Pixel<int>* pixels, uint8_t* rgb, int count) {
+	//the color halves of 4 pixels into the low lane
+	const __m256i colorHalves = _mm256_setr_epi32(0, 2, 4, 6, 0, 0, 0, 0);
+	const __m256i squeeze = _mm256_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1,
+		0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+	//the 12 bytes of each lane next to each other
+	const __m256i join = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 7, 7);
+	int i = 0;
+	for (; i + 8 <= count; i += 8) {
+		__m256i low = _mm256_permutevar8x32_epi32(_mm256_loadu_si256((const __m256i*)(pixels + i)), colorHalves);
+		__m256i high = _mm256_permutevar8x32_epi32(_mm256_loadu_si256((const __m256i*)(pixels + i + 4)), colorHalves);
+		__m256i colors = _mm256_inserti128_si256(low, _mm256_castsi256_si128(high), 1);
+		colors = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(colors, squeeze), join);
+		_mm_storeu_si128((__m128i*)(rgb + 3 * i), _mm256_castsi256_si128(colors));
+		_mm_storel_epi64((__m128i*)(rgb + 3 * i + 16), _mm256_extracti128_si256(colors, 1));
+	}
+	return i;
+}
+#endif
+
+void packPixels(const uint8_t* rgb, Pixel<int>* pixels, int first, int count, SimdLevel level) {
+	int done = 0;
+#ifdef SIMD_X86
+	if (level >= SIMD_AVX2) {
+		done = packPixelsAVX2(rgb, pixels, first, count);
+	}
+	else if (level >= SIMD_SSSE3) {
+		done = packPixelsSSSE3(rgb, pixels, first, count);
+	}
+#endif
+	packPixels<int>(rgb + 3 * done, pixels + done, first + done, count - done);
+}
+
+//an int index has the SIMD loops, with the best level the cpu has
+void packPixels(const uint8_t* rgb, Pixel<int>* pixels, int first, int count) {
+	packPixels(rgb, pixels, first, count, simdLevel());
+}
+
+void unpackPixels(const Pixel<int>* pixels, uint8_t* rgb, int count, SimdLevel level) {
+	int done = 0;
+#ifdef SIMD_X86
+	if (level >= SIMD_AVX2) {
+		done = unpackPixelsAVX2(pixels, rgb, count);
+	}
+	else if (level >= SIMD_SSSE3) {
+		done = unpackPixelsSSSE3(pixels, rgb, count);
+	}
+#endif
+	unpackPixels<int>(pixels + done, rgb + 3 * done, count - done);
+}
+
+void unpackPixels(const Pixel<int>* pixels, uint8_t* rgb, int count) {
+	unpackPixels(pixels, rgb, count, simdLevel());
+}
+
+
+template <typename Index>
+Pixel<Index>* getOrderedPixelFromRBG(uint8_t* rgb, Index size) {
+	Pixel<Index>* newArray;
+	trackAlloc(MEM_PIXELS, (long long)size * sizeof(Pixel<Index>));
+	newArray = new Pixel<Index>[size];
+	orderPixels(rgb, newArray, size);
+	return newArray;
+}
+
+//fills pixelArr with the pixels of rgb, each at its own position
+template <typename Index>
+void orderPixels(uint8_t* rgb, Pixel<Index>* pixelArr, Index size) {
+	//width & height are amount of pixels, not amount of elements
+	//thus there are 3*width*height actual elements in the rgb array
+	forPixelBands(size, [&](Index first, Index count) {
+		packPixels(rgb + 3 * (size_t)first, pixelArr + first, first, count);
+	});
+}
+
+template <typename Index>
+void freePixelArray(Pixel<Index>* pixelArr, Index size) {
+	trackFree(MEM_PIXELS, (long long)size * sizeof(Pixel<Index>));
+	delete[] pixelArr;
+}
+
+template <typename Index>
+uint8_t* getRGBFromOrderedPixel(Pixel<Index>* pixelArr, Index size){
+	unsigned char* newArray;
+	newArray = new unsigned char[(size_t)size * 3];
+	updateRGB(pixelArr, newArray, size);
+	return newArray;
+}
+
+
+/*----------------------------------------------------------UPDATE FUNCTIONS-------------------------------------------------------*/
+inline void updateVisual(RenderContext* ctx) {
+	if (ctx->quiet || ctx->frameCount < ctx->replayUntil) {
+		ctx->frameCount++;
+		return;
+	}
+	switch (ctx->frameCount % 1000) {
+	case 0: ctx->loadSign = '\\';
+		break;
+	case 250: ctx->loadSign = '|';
+		break;
+	case 500: ctx->loadSign = '/';
+		break;
+	case 750: ctx->loadSign = '-';
+		break;
+	}
+	std::cout << "\r" << ctx->loadSign << "Generating Video, Frame: " << ctx->frameCount++ << ctx->loadSign << "\r";
+}
+
+//the name of the sort printed before every operation
+inline void printOperation(RenderContext* ctx, const char* name) {
+	if (!ctx->quiet && ctx->frameCount >= ctx->replayUntil) {
+		std::cout << name;
 	}
-	std::cout << "\r" << LOADSIGN << "Generating Video, Frame: " << FRAMECOUNT++ << LOADSIGN << "\r";
 }
 //this function is not really used, as it is more efficient to 
 //just update the pixels as needed, instead of the entire photo
-void updateRGB(Pixel* pixelArr, uint8_t* RGB, int size) {
-	for (int i = 0; i < size; i++) {
-		RGB[i * 3] = pixelArr[i].r;
-		RGB[i * 3 + 1] = pixelArr[i].g;
-		RGB[i * 3 + 2] = pixelArr[i].b;
-	}
-	
+template <typename Index>
+void updateRGB(Pixel<Index>* pixelArr, uint8_t* RGB, Index size) {
+	forPixelBands(size, [&](Index first, Index count) {
+		unpackPixels(pixelArr + first, RGB + 3 * (size_t)first, count);
+	});
 }
 
 //changes a single pixel inside the pixel array to be the same as a new pixel
-void updatePixel(Pixel* pixelArr, uint8_t* rgb, Pixel newPix, int index, int size, VideoCapture* capture) {
+template <typename Index>
+void updatePixel(Pixel<Index>* pixelArr, uint8_t* rgb, Pixel<Index> newPix, Index index, Index size, RenderContext* ctx) {
 	pixelArr[index].r = newPix.r;
 	pixelArr[index].g = newPix.g;
 	pixelArr[index].b = newPix.b;
 	pixelArr[index].position = newPix.position;
 
-	updateVisual();
+	updateVisual(ctx);
 
 
-	updateSingleRGB(pixelArr, rgb, index);
-	if (FRAMECOUNT%SKIP == 0) {
-		capture->AddFrame(rgb);
+	ctx->changed += updateSingleRGB(pixelArr, rgb, index);
+	touchPixel(ctx, index);
+	if (ctx->frameCount % ctx->skip == 0) {
+		addFrame(rgb, ctx);
 	}
 	
 }
 
-void updateSingleRGB(Pixel* pixelArr, uint8_t* RGB, int index) {
+//returns whether the pixel's color actually changed
+template <typename Index>
+bool updateSingleRGB(Pixel<Index>* pixelArr, uint8_t* RGB, Index index) {
+	bool changed = RGB[index * 3] != pixelArr[index].r || RGB[index * 3 + 1] != pixelArr[index].g || RGB[index * 3 + 2] != pixelArr[index].b;
 	RGB[index * 3] = pixelArr[index].r;
 	RGB[index * 3 + 1] = pixelArr[index].g;
 	RGB[index * 3 + 2] = pixelArr[index].b;
+	return changed;
 }
 
-void copyPixelArray(Pixel* pixelArr, Pixel* newArr, int size) {
-	for (int i = 0; i < size; i++) {
-		newArr[i].r = pixelArr[i].r;
-		newArr[i].g = pixelArr[i].g;
-		newArr[i].b = pixelArr[i].b;
-		newArr[i].position = pixelArr[i].position;
-	}
+template <typename Index>
+void copyPixelArray(Pixel<Index>* pixelArr, Pixel<Index>* newArr, Index size) {
+	//whole pixels, padding and all, which memcpy already moves as fast as the memory allows
+	forPixelBands(size, [&](Index first, Index count) {
+		memcpy(newArr + first, pixelArr + first, (size_t)count * sizeof(Pixel<Index>));
+	});
 }
 
 /*---------------------------------------------------------------DEBUG PRINTS-------------------------------------------------------*/
 
-void printPixels(Pixel* pixelArr, int size){
-	for (int i = 0; i < size; i++) {
+template <typename Index>
+void printPixels(Pixel<Index>* pixelArr, Index size){
+	for (Index i = 0; i < size; i++) {
 		printf("%d: (%X, %X, %X)\n", pixelArr[i].position, pixelArr[i].r, pixelArr[i].g, pixelArr[i].b);
 	}
 }
@@ -649,65 +2083,132 @@ void printRGB(unsigned char* rgbArr, int size) {
 }
 
 
+/*---------------------------------------------------------------RUN REPORT-------------------------------------------------------*/
+
+//printed after create, so a run that got too big shows which part was responsible
+void printRunReport(RenderContext* ctx, int width, int height, double seconds) {
+	std::cout << "-------------------------------------------------------------------------------------" << std::endl;
+	printf("image         %d x %d (%lld pixels%s)\n", width, height, (long long)width * height, needsWideIndex((long long)width * height) ? ", 64 bit indices" : "");
+	if (ctx->tiles.on()) {
+		printf("tiles         %s\n", tilesName(ctx->tiles).c_str());
+	}
+	printf("operations    %llu\n", ctx->frameCount);
+	printf("time          %.1f s\n", seconds);
+	printMemoryReport();
+	std::cout << "-------------------------------------------------------------------------------------" << std::endl;
+}
+
+
 /*--------------------------------------------------------------------shuffle, swap, and delays-----------------------------------------------------------------*/
 
+//below size, from two draws of the generator for images past what one reaches
+template <typename Index>
+inline Index randomIndex(RenderContext* ctx, Index size) {
+	if ((unsigned long long)size <= 0xFFFFFFFFULL) {
+		return (Index)(ctx->rng() % (unsigned long long)size);
+	}
+	unsigned long long high = ctx->rng() & 0xFFFFFFFFULL;
+	return (Index)(((high << 32) | (ctx->rng() & 0xFFFFFFFFULL)) % (unsigned long long)size);
+}
+
 //used to randomize the pixels in a visual way, each swap is captured and added to the video
-void shufflePixels(Pixel* pixelArr, uint8_t* rgb, int size, VideoCapture* capture){
-	srand(time(0));
-	int randIndex;
-	for (int i = 0; i < size; i++) {
-		//when using larger images, the rand function will not
-		//produce values up to the size, so a larger number is needed
-		randIndex = (rand()*rand()) % size;
-		std::cout << "shuffle ";
-		swap(pixelArr, rgb,  i, randIndex, size, capture);
+template <typename Index>
+void shufflePixels(Pixel<Index>* pixelArr, uint8_t* rgb, Index size, RenderContext* ctx){
+	ctx->rng.seed(ctx->seed ? ctx->seed : time(0));
+	Index randIndex;
+	for (Index i = 0; i < size; i++) {
+		//rand() is shared between threads and doesn't reach past 32767
+		//on windows, so each render has its own generator
+		randIndex = randomIndex(ctx, size);
+		printOperation(ctx, "shuffle ");
+		swap(pixelArr, rgb,  i, randIndex, size, ctx);
 	}
 
 }
 //used to start a sort shuffled, or instantly shuffle (in terms of the video
-void shuffleNoVid(Pixel* pixelArr, uint8_t* rgb, int size) {
-	srand(time(0));
-	int randIndex;
-	for (int i = 0; i < size; i++) {
-		randIndex = rand() % size;
-		swapNoFrame(pixelArr, rgb, i, randIndex, size);
+template <typename Index>
+void shuffleNoVid(Pixel<Index>* pixelArr, uint8_t* rgb, Index size, RenderContext* ctx) {
+	ctx->rng.seed(ctx->seed ? ctx->seed : time(0));
+	Index randIndex;
+	for (Index i = 0; i < size; i++) {
+		randIndex = randomIndex(ctx, size);
+		swapNoFrame(pixelArr, rgb, i, randIndex, size, ctx);
 	}
 
 }
 
+//widens the range of pixels written since the last frame
+template <typename Index>
+inline void touchPixel(RenderContext* ctx, Index index) {
+	if (ctx->touchedFirst < 0 || index < ctx->touchedFirst) {
+		ctx->touchedFirst = index;
+	}
+	if (index > ctx->touchedLast) {
+		ctx->touchedLast = index;
+	}
+}
+
 //used for swapping pixels without creating a frame
-void swapNoFrame(Pixel* pixelArr, uint8_t* rgb, int index1, int index2, int size) {
-	Pixel tempPixel = pixelArr[index1];
+template <typename Index>
+void swapNoFrame(Pixel<Index>* pixelArr, uint8_t* rgb, Index index1, Index index2, Index size, RenderContext* ctx) {
+	Pixel<Index> tempPixel = pixelArr[index1];
 	pixelArr[index1] = pixelArr[index2];
 	pixelArr[index2] = tempPixel;
 	//capture the image at this moment
-	updateVisual();
+	updateVisual(ctx);
 
-	updateSingleRGB(pixelArr, rgb, index1);
-	updateSingleRGB(pixelArr, rgb, index2);
+	ctx->changed += updateSingleRGB(pixelArr, rgb, index1);
+	ctx->changed += updateSingleRGB(pixelArr, rgb, index2);
 }
 
-void swap(Pixel* pixelArr, uint8_t* rgb, int index1, int index2, int size, VideoCapture* capture) {
-	Pixel tempPixel = pixelArr[index1];
+template <typename Index>
+void swap(Pixel<Index>* pixelArr, uint8_t* rgb, Index index1, Index index2, Index size, RenderContext* ctx) {
+	Pixel<Index> tempPixel = pixelArr[index1];
 	pixelArr[index1] = pixelArr[index2];
 	pixelArr[index2] = tempPixel;
 	//capture the image at this moment
-	updateVisual();
-	updateSingleRGB(pixelArr, rgb, index1);
-	updateSingleRGB(pixelArr, rgb, index2);
-	if (FRAMECOUNT%SKIP == 0) {
-		capture->AddFrame(rgb);
+	updateVisual(ctx);
+	ctx->changed += updateSingleRGB(pixelArr, rgb, index1);
+	ctx->changed += updateSingleRGB(pixelArr, rgb, index2);
+	touchPixel(ctx, index1);
+	touchPixel(ctx, index2);
+	if (ctx->frameCount % ctx->skip == 0) {
+		addFrame(rgb, ctx);
 	}
 
 }
 
 
+//hands the current image to the capture, along with what changed since the last one
+void addFrame(uint8_t* rgb, RenderContext* ctx) {
+	//a resumed action is run again from its start, these frames are already in the segments
+	if (ctx->frameCount <= ctx->replayUntil) {
+		ctx->changed = 0;
+		ctx->touchedFirst = -1;
+		ctx->touchedLast = -1;
+		return;
+	}
+	FrameInfo info;
+	info.operation = ctx->frameCount;
+	info.changed = ctx->changed;
+	info.touchedFirst = ctx->touchedFirst;
+	info.touchedLast = ctx->touchedLast;
+	ctx->capture->SetFrameInfo(info);
+	ctx->capture->AddFrame(rgb);
+	ctx->changed = 0;
+	ctx->touchedFirst = -1;
+	ctx->touchedLast = -1;
+	if (ctx->checkpoint) {
+		checkpointRender(ctx);
+	}
+}
+
 //add still frames to the video of amount frames
-void delay(uint8_t* rgb, int frames, VideoCapture* capture) {
+void delay(uint8_t* rgb, int frames, RenderContext* ctx) {
 
 	for (int i = 0; i < frames; i++) {
-		updateVisual();
-		capture->AddFrame(rgb);
+		updateVisual(ctx);
+		addFrame(rgb, ctx);
 		
 	}
 }
@@ -718,14 +2219,15 @@ void delay(uint8_t* rgb, int frames, VideoCapture* capture) {
 	
 
 //bubble sort
-void bubbleSort(Pixel* pixelArr, uint8_t* rgb, int size, VideoCapture* capture){
+template <typename Index>
+void bubbleSort(Pixel<Index>* pixelArr, uint8_t* rgb, Index size, RenderContext* ctx){
 	bool noSwap;
-	for (int i = 0; i < size; i++) {
+	for (Index i = 0; i < size; i++) {
 		noSwap = true;
-		for (int j = 0; j < size-1; j++) {
+		for (Index j = 0; j < size-1; j++) {
 			if (pixelArr[j].position > pixelArr[j + 1].position) {
-				std::cout << "bubble ";
-				swap(pixelArr, rgb, j, j + 1, size, capture);
+				printOperation(ctx, "bubble ");
+				swap(pixelArr, rgb, j, j + 1, size, ctx);
 				noSwap = false;
 			}
 		}
@@ -738,14 +2240,16 @@ void bubbleSort(Pixel* pixelArr, uint8_t* rgb, int size, VideoCapture* capture){
 
 //merge sort
 
-void merge(Pixel* pixelArr, uint8_t* rgb, int size, int left, int mid, int right, VideoCapture* capture) {
-	int i, j, k;
-	int leftSize = mid - left + 1;
-	int rightSize = right - mid;
+template <typename Index>
+void merge(Pixel<Index>* pixelArr, uint8_t* rgb, Index size, Index left, Index mid, Index right, RenderContext* ctx) {
+	Index i, j, k;
+	Index leftSize = mid - left + 1;
+	Index rightSize = right - mid;
 	//make temporary arrays
-	Pixel *L, *R;
-	L = new Pixel[leftSize];
-	R = new Pixel[rightSize];
+	Pixel<Index> *L, *R;
+	trackAlloc(MEM_SCRATCH, (long long)(leftSize + rightSize) * sizeof(Pixel<Index>));
+	L = new Pixel<Index>[leftSize];
+	R = new Pixel<Index>[rightSize];
 
 	for (i = 0; i < leftSize; i++)
 		L[i] = pixelArr[left + i];
@@ -759,13 +2263,13 @@ void merge(Pixel* pixelArr, uint8_t* rgb, int size, int left, int mid, int right
 
 	while (i < leftSize && j < rightSize) {
 		if (L[i].position <= R[j].position) {
-			std::cout << "merge ";
-			updatePixel(pixelArr, rgb, L[i], k, size, capture);
+			printOperation(ctx, "merge ");
+			updatePixel(pixelArr, rgb, L[i], k, size, ctx);
 			i++;
 		}
 		else {
-			std::cout << "merge ";
-			updatePixel(pixelArr, rgb, R[j], k, size, capture);
+			printOperation(ctx, "merge ");
+			updatePixel(pixelArr, rgb, R[j], k, size, ctx);
 			j++;
 		}
 		k++;
@@ -773,14 +2277,14 @@ void merge(Pixel* pixelArr, uint8_t* rgb, int size, int left, int mid, int right
 
 	//copy remaining 
 	while (i < leftSize) {
-		std::cout << "merge ";
-		updatePixel(pixelArr, rgb, L[i], k, size, capture);
+		printOperation(ctx, "merge ");
+		updatePixel(pixelArr, rgb, L[i], k, size, ctx);
 		i++;
 		k++;
 	}
 	while (j < rightSize) {
-		std::cout << "merge ";
-		updatePixel(pixelArr, rgb, R[j], k, size, capture);
+		printOperation(ctx, "merge ");
+		updatePixel(pixelArr, rgb, R[j], k, size, ctx);
 		j++;
 		k++;
 	}
@@ -789,9 +2293,11 @@ void merge(Pixel* pixelArr, uint8_t* rgb, int size, int left, int mid, int right
 	L = NULL;
 	delete[] R;
 	R = NULL;
+	trackFree(MEM_SCRATCH, (long long)(leftSize + rightSize) * sizeof(Pixel<Index>));
 }
 
-void mergeSort(Pixel* pixelArr, uint8_t* rgb, int size, VideoCapture* capture, int left, int right) {
+template <typename Index>
+void mergeSort(Pixel<Index>* pixelArr, uint8_t* rgb, Index size, RenderContext* ctx, Index left, Index right) {
 
 	if (right == -1) {	//for first entry
 		right = size - 1; 
@@ -799,12 +2305,12 @@ void mergeSort(Pixel* pixelArr, uint8_t* rgb, int size, VideoCapture* capture, i
 	
 	if (left < right) {
 		//find midpoint
-		int mid = left + (right - left) / 2;
+		Index mid = left + (right - left) / 2;
 		//sort the left and right
-		mergeSort(pixelArr, rgb, size, capture, left, mid);
-		mergeSort(pixelArr, rgb, size, capture, mid + 1, right);
+		mergeSort(pixelArr, rgb, size, ctx, left, mid);
+		mergeSort(pixelArr, rgb, size, ctx, mid + 1, right);
 		//merge the halves
-		merge(pixelArr, rgb, size, left, mid, right, capture);
+		merge(pixelArr, rgb, size, left, mid, right, ctx);
 	}
 }
 
@@ -813,51 +2319,59 @@ void mergeSort(Pixel* pixelArr, uint8_t* rgb, int size, VideoCapture* capture, i
 //quick sort 
 
 //takes last element as partition
-int partition(Pixel* pixelArr, uint8_t* rgb, int size, VideoCapture* capture, int low, int high) {
-	Pixel pivot = pixelArr[high];
-	int leftInd = low - 1;
+template <typename Index>
+Index partition(Pixel<Index>* pixelArr, uint8_t* rgb, Index size, RenderContext* ctx, Index low, Index high) {
+	Pixel<Index> pivot = pixelArr[high];
+	Index leftInd = low - 1;
 
-	for (int i = low; i <= high - 1; i++) {
+	for (Index i = low; i <= high - 1; i++) {
 		if (pixelArr[i].position <= pivot.position) {
 			leftInd++;
-			std::cout << "quick ";
-			swap(pixelArr, rgb, leftInd, i, size, capture);
+			printOperation(ctx, "quick ");
+			swap(pixelArr, rgb, leftInd, i, size, ctx);
 		}
 	}
 	//take the partition from the end of the list, and centre it
-	std::cout << "quick ";
-	swap(pixelArr, rgb, leftInd + 1, high, size, capture);
+	printOperation(ctx, "quick ");
+	swap(pixelArr, rgb, leftInd + 1, high, size, ctx);
 	return (leftInd + 1);
 }
 
-void quickSort(Pixel* pixelArr, uint8_t* rgb, int size, VideoCapture* capture, int low, int high) {
+template <typename Index>
+void quickSort(Pixel<Index>* pixelArr, uint8_t* rgb, Index size, RenderContext* ctx, Index low, Index high) {
 	
 	if (high == -1) { //for first entry
 		high = size - 1;
 	}
 
 	if (low < high) {
-		int partitionInd = partition(pixelArr, rgb, size, capture, low, high);
-		quickSort(pixelArr, rgb, size, capture, low, partitionInd-1); //left of part
-		quickSort(pixelArr, rgb, size, capture, partitionInd + 1, high); //right of part
+		Index partitionInd = partition(pixelArr, rgb, size, ctx, low, high);
+		//an empty left part would pass high = -1, which means the whole array
+		if (low < partitionInd - 1) {
+			quickSort(pixelArr, rgb, size, ctx, low, partitionInd - 1); //left of part
+		}
+		quickSort(pixelArr, rgb, size, ctx, partitionInd + 1, high); //right of part
 	}
 }
 
 //heap sort
 
-int getLeftChild(int index) { return index * 2 + 1; }
-int getRightChild(int index) { return index * 2 + 2; }
-bool hasLeftChild(int index, int size) {
+template <typename Index> Index getLeftChild(Index index) { return index * 2 + 1; }
+template <typename Index> Index getRightChild(Index index) { return index * 2 + 2; }
+template <typename Index>
+bool hasLeftChild(Index index, Index size) {
 	return getLeftChild(index) < size;
 }
-bool hasRightChild(int index, int size) {
+template <typename Index>
+bool hasRightChild(Index index, Index size) {
 	return getRightChild(index) < size;
 }
 
 
 
-void siftDown(Pixel* pixelArr, uint8_t* rgb, int size, int currentRoot, VideoCapture* capture) {
-	int largestIndex = currentRoot;
+template <typename Index>
+void siftDown(Pixel<Index>* pixelArr, uint8_t* rgb, Index size, Index currentRoot, RenderContext* ctx) {
+	Index largestIndex = currentRoot;
 
 	if (hasLeftChild(currentRoot, size)) {
 		//check if left is larger than root
@@ -872,30 +2386,32 @@ void siftDown(Pixel* pixelArr, uint8_t* rgb, int size, int currentRoot, VideoCap
 
 
 	if (currentRoot != largestIndex) {
-		std::cout << "heap max ";
-		swap(pixelArr, rgb, currentRoot, largestIndex, size, capture);
-		siftDown(pixelArr, rgb, size, largestIndex, capture);//repeat until no swaps are needed
+		printOperation(ctx, "heap max ");
+		swap(pixelArr, rgb, currentRoot, largestIndex, size, ctx);
+		siftDown(pixelArr, rgb, size, largestIndex, ctx);//repeat until no swaps are needed
 	}
 }
 
-void heapify(Pixel* pixelArr, uint8_t* rgb, int size, VideoCapture* capture) {
+template <typename Index>
+void heapify(Pixel<Index>* pixelArr, uint8_t* rgb, Index size, RenderContext* ctx) {
 	//start at 2nd last row and move up
-	for (int i = size / 2 - 1; i >= 0; i--) {
-		siftDown(pixelArr,rgb, size, i, capture);
+	for (Index i = size / 2 - 1; i >= 0; i--) {
+		siftDown(pixelArr,rgb, size, i, ctx);
 	}
 }
 
-void heapSort(Pixel* pixelArr, uint8_t* rgb, int size, VideoCapture* capture) {
+template <typename Index>
+void heapSort(Pixel<Index>* pixelArr, uint8_t* rgb, Index size, RenderContext* ctx) {
 
-	heapify(pixelArr, rgb, size, capture);
-	for (int i = size - 1; i >= 0; i--)
+	heapify(pixelArr, rgb, size, ctx);
+	for (Index i = size - 1; i >= 0; i--)
 	{
 		// move root to end
-		std::cout << "heap max ";
-		swap(pixelArr, rgb, 0, i, size, capture);
+		printOperation(ctx, "heap max ");
+		swap(pixelArr, rgb, (Index)0, i, size, ctx);
 		
 		// call recreate the heap
-		siftDown(pixelArr, rgb, i, 0, capture);
+		siftDown(pixelArr, rgb, i, (Index)0, ctx);
 	}
 }
 
@@ -904,16 +2420,18 @@ void heapSort(Pixel* pixelArr, uint8_t* rgb, int size, VideoCapture* capture) {
 
 //minimum heap sort
 
-void reverseInPlace(Pixel* pixelArr, uint8_t* rgb, int size, VideoCapture* capture) {
-	for (int i = 0; i < size/2; i++) {
-		std::cout << "reverse ";
-		swap(pixelArr, rgb, i, size - i-1, size, capture);
+template <typename Index>
+void reverseInPlace(Pixel<Index>* pixelArr, uint8_t* rgb, Index size, RenderContext* ctx) {
+	for (Index i = 0; i < size/2; i++) {
+		printOperation(ctx, "reverse ");
+		swap(pixelArr, rgb, i, size - i-1, size, ctx);
 	}
 }
 
 
-void siftDownMin(Pixel* pixelArr, uint8_t* rgb, int size, int currentRoot, VideoCapture* capture) {
-	int smallestIndex = currentRoot;
+template <typename Index>
+void siftDownMin(Pixel<Index>* pixelArr, uint8_t* rgb, Index size, Index currentRoot, RenderContext* ctx) {
+	Index smallestIndex = currentRoot;
 
 	if (hasLeftChild(currentRoot, size)) {
 		//check if left is smaller than root
@@ -927,36 +2445,38 @@ void siftDownMin(Pixel* pixelArr, uint8_t* rgb, int size, int currentRoot, Video
 	}
 
 	if (currentRoot != smallestIndex) {
-		std::cout << "heap min ";
-		swap(pixelArr, rgb, currentRoot, smallestIndex, size, capture);
-		siftDownMin(pixelArr, rgb, size, smallestIndex, capture);//repeat until no swaps are needed
+		printOperation(ctx, "heap min ");
+		swap(pixelArr, rgb, currentRoot, smallestIndex, size, ctx);
+		siftDownMin(pixelArr, rgb, size, smallestIndex, ctx);//repeat until no swaps are needed
 	}
 }
 
 
 
 
-void heapifyMin(Pixel* pixelArr, uint8_t* rgb, int size, VideoCapture* capture){
+template <typename Index>
+void heapifyMin(Pixel<Index>* pixelArr, uint8_t* rgb, Index size, RenderContext* ctx){
 	//start at 2nd last row and move up
-	for (int i = size / 2 - 1; i >= 0; i--) {
-		siftDownMin(pixelArr, rgb, size, i, capture);
+	for (Index i = size / 2 - 1; i >= 0; i--) {
+		siftDownMin(pixelArr, rgb, size, i, ctx);
 	}
 
 }
 
 
-void heapSortMin(Pixel* pixelArr, uint8_t* rgb, int size, VideoCapture* capture){
-	heapifyMin(pixelArr, rgb, size, capture);
-	for (int i = size - 1; i >= 0; i--)
+template <typename Index>
+void heapSortMin(Pixel<Index>* pixelArr, uint8_t* rgb, Index size, RenderContext* ctx){
+	heapifyMin(pixelArr, rgb, size, ctx);
+	for (Index i = size - 1; i >= 0; i--)
 	{
-		std::cout << "heap min ";
+		printOperation(ctx, "heap min ");
 		// move root to end
-		swap(pixelArr, rgb, 0, i, size, capture);
+		swap(pixelArr, rgb, (Index)0, i, size, ctx);
 
 		// call recreate the heap
-		siftDownMin(pixelArr, rgb, i, 0, capture);
+		siftDownMin(pixelArr, rgb, i, (Index)0, ctx);
 	}
-	reverseInPlace(pixelArr, rgb, size, capture);
+	reverseInPlace(pixelArr, rgb, size, ctx);
 }
 
 
@@ -964,33 +2484,35 @@ void heapSortMin(Pixel* pixelArr, uint8_t* rgb, int size, VideoCapture* capture)
 //counting sort
 
 
-void countingSort(Pixel* pixelArr, uint8_t* rgb, int size, VideoCapture* capture) {
-	int* countArr;
-	countArr = new int[size];
-	Pixel* newArr;
-	newArr = new Pixel[size];
+template <typename Index>
+void countingSort(Pixel<Index>* pixelArr, uint8_t* rgb, Index size, RenderContext* ctx) {
+	Index* countArr;
+	trackAlloc(MEM_SCRATCH, (long long)size * (sizeof(Index) + sizeof(Pixel<Index>)));
+	countArr = new Index[size];
+	Pixel<Index>* newArr;
+	newArr = new Pixel<Index>[size];
 	copyPixelArray(pixelArr, newArr, size);
 
 
 	//create the count array
-	for (int i = 0; i < size; i++) {
+	for (Index i = 0; i < size; i++) {
 		countArr[i] = 0;
 	}
-	for (int i = 0; i < size; i++) {
+	for (Index i = 0; i < size; i++) {
 		countArr[pixelArr[i].position] += 1;
 	}
 
 	//modify the count array to the cumulative version
-	for (int i = 1; i < size; i++) {
+	for (Index i = 1; i < size; i++) {
 		countArr[i] += countArr[i - 1];
 	}
 
 
 	//go through the last Array backwards and create sorted array
-	for (int i = size - 1; i >= 0; i--) {
+	for (Index i = size - 1; i >= 0; i--) {
 		countArr[newArr[i].position]--;
-		std::cout << "count ";
-		updatePixel(pixelArr, rgb, newArr[i], countArr[newArr[i].position], size, capture);
+		printOperation(ctx, "count ");
+		updatePixel(pixelArr, rgb, newArr[i], countArr[newArr[i].position], size, ctx);
 	}
 
 	//delete temp arrays
@@ -998,29 +2520,33 @@ void countingSort(Pixel* pixelArr, uint8_t* rgb, int size, VideoCapture* capture
 	delete[] countArr;
 	countArr = NULL;
 	newArr = NULL;
+	trackFree(MEM_SCRATCH, (long long)size * (sizeof(Index) + sizeof(Pixel<Index>)));
 }
 
 
 
 //radix base 10
 
-int powTen(int n) {
-	int power = 1;
+template <typename Index>
+Index powTen(int n) {
+	Index power = 1;
 	for (int i = 0; i < n; i++) {
 		power *= 10;
 	}
 	return power;
 }
 
-int getDigit(int num, int digitIndex) {
-	int finalNum = num;
-	finalNum = finalNum / powTen(digitIndex);
+template <typename Index>
+int getDigit(Index num, int digitIndex) {
+	Index finalNum = num;
+	finalNum = finalNum / powTen<Index>(digitIndex);
 	return finalNum % 10;
 }
 
-int getNumDigits(int num) {
+template <typename Index>
+int getNumDigits(Index num) {
 	int i = 0;
-	while (num >= powTen(i)) {
+	while (num >= powTen<Index>(i)) {
 		i++;
 	}
 	if (i == 0) {
@@ -1029,18 +2555,20 @@ int getNumDigits(int num) {
 	return i;
 }
 
-void countingSortRadix(Pixel* pixelArr, uint8_t* rgb, int size, int range, int digit, VideoCapture* capture) {
-	int* countArr;
-	Pixel* newArr;
-	newArr = new Pixel[size];
+template <typename Index>
+void countingSortRadix(Pixel<Index>* pixelArr, uint8_t* rgb, Index size, int range, int digit, RenderContext* ctx) {
+	Index* countArr;
+	Pixel<Index>* newArr;
+	trackAlloc(MEM_SCRATCH, (long long)size * sizeof(Pixel<Index>) + range * sizeof(Index));
+	newArr = new Pixel<Index>[size];
 	copyPixelArray(pixelArr, newArr, size);
-	countArr = new int[range];
+	countArr = new Index[range];
 
 	//create the count array
 	for (int i = 0; i < range; i++) {
 		countArr[i] = 0;
 	}
-	for (int i = 0; i < size; i++) {
+	for (Index i = 0; i < size; i++) {
 		countArr[getDigit(pixelArr[i].position, digit)] += 1;
 	}
 
@@ -1050,10 +2578,10 @@ void countingSortRadix(Pixel* pixelArr, uint8_t* rgb, int size, int range, int d
 	}
 
 	//go through the last Array backwards and create sorted array
-	for (int i = size - 1; i >= 0; i--) {
+	for (Index i = size - 1; i >= 0; i--) {
 		countArr[getDigit(newArr[i].position, digit)]--;
-		std::cout << "radix ";
-		updatePixel(pixelArr, rgb, newArr[i], countArr[getDigit(newArr[i].position, digit)], size, capture);
+		printOperation(ctx, "radix ");
+		updatePixel(pixelArr, rgb, newArr[i], countArr[getDigit(newArr[i].position, digit)], size, ctx);
 	}
 
 
@@ -1062,15 +2590,1694 @@ void countingSortRadix(Pixel* pixelArr, uint8_t* rgb, int size, int range, int d
 	delete[] countArr;
 	countArr = NULL;
 	newArr = NULL;
+	trackFree(MEM_SCRATCH, (long long)size * sizeof(Pixel<Index>) + range * sizeof(Index));
 }
 
-//(Pixel* pixelArr, uint8_t* rgb, int size, VideoCapture* capture)
-void radixSortBaseTen(Pixel* pixelArr, uint8_t* rgb, int size, VideoCapture* capture) {
+template <typename Index>
+void radixSortBaseTen(Pixel<Index>* pixelArr, uint8_t* rgb, Index size, RenderContext* ctx) {
 	int range = getNumDigits(size);
 	for (int i = 0; i < range; i++) {
-		countingSortRadix(pixelArr, rgb, size, 10, i, capture);
+		countingSortRadix(pixelArr, rgb, size, 10, i, ctx);
+	}
+}
+
+//the out of core sorts only go through the pixel array (and their scratch) front to
+//back, a block at a time, so a mapped image is read and written in long runs instead
+//of paging in and out at random like the other sorts would
+#define EXT_RUN_PIXELS (1 << 20)	//extMergeSort sorts runs of this many pixels in memory
+#define EXT_MERGE_WAYS 16			//and merges this many runs at once
+#define EXT_BLOCK_PIXELS 1024		//blockRadixSort gathers this many pixels per bucket before writing them
+
+//scratch the size of the pixel array, in a file when the render is mapped
+template <typename Index>
+Pixel<Index>* allocExternalScratch(Index size, MappedFile* file, RenderContext* ctx) {
+	if (ctx->mapDir.empty()) {
+		trackAlloc(MEM_SCRATCH, (long long)size * sizeof(Pixel<Index>));
+		return new Pixel<Index>[size];
+	}
+	if (!file->Open(ctx->mapDir, "scratch", (size_t)size * sizeof(Pixel<Index>))) {
+		throw std::runtime_error("couldn't map the scratch in " + ctx->mapDir);
+	}
+	file->Advise(MAP_ADVICE_SEQUENTIAL);
+	return (Pixel<Index>*)file->Data();
+}
+
+template <typename Index>
+void freeExternalScratch(Pixel<Index>* scratch, Index size, MappedFile* file) {
+	if (file->Data()) {
+		file->Close();
+		return;
+	}
+	delete[] scratch;
+	trackFree(MEM_SCRATCH, (long long)size * sizeof(Pixel<Index>));
+}
+
+//how many times extMergeSort writes every pixel: once for the runs, once per merge pass
+int extMergePasses(long long size) {
+	int passes = 1;
+	for (long long width = EXT_RUN_PIXELS; width < size; width *= EXT_MERGE_WAYS) {
+		passes++;
+	}
+	return passes;
+}
+
+//merges the sorted runs of scratch from start to end, width apart, into the pixel array
+template <typename Index>
+void extMergeGroup(Pixel<Index>* pixelArr, uint8_t* rgb, Pixel<Index>* scratch, Index size, long long start, long long end, long long width, RenderContext* ctx) {
+	//the next pixel of every run by position, smallest on top
+	std::vector<std::pair<Index, int> > heads;
+	std::vector<Index> next, ends;
+	for (long long run = start; run < end; run += width) {
+		heads.push_back(std::make_pair(scratch[run].position, (int)next.size()));
+		next.push_back((Index)run);
+		ends.push_back((Index)std::min(end, run + width));
+	}
+	std::greater<std::pair<Index, int> > later;
+	std::make_heap(heads.begin(), heads.end(), later);
+	for (Index i = (Index)start; i < (Index)end; i++) {
+		std::pop_heap(heads.begin(), heads.end(), later);
+		int run = heads.back().second;
+		printOperation(ctx, "ext merge ");
+		updatePixel(pixelArr, rgb, scratch[next[run]], i, size, ctx);
+		if (++next[run] < ends[run]) {
+			heads.back().first = scratch[next[run]].position;
+			std::push_heap(heads.begin(), heads.end(), later);
+		}
+		else {
+			heads.pop_back();
+		}
+	}
+}
+
+//external merge sort: runs that fit in memory are sorted and written back, then
+//merged EXT_MERGE_WAYS at a time through a scratch copy until one run is left
+template <typename Index>
+void extMergeSort(Pixel<Index>* pixelArr, uint8_t* rgb, Index size, RenderContext* ctx) {
+	Index runLength = std::min<Index>(size, EXT_RUN_PIXELS);
+	trackAlloc(MEM_SCRATCH, (long long)runLength * sizeof(Pixel<Index>));
+	Pixel<Index>* run = new Pixel<Index>[runLength];
+	for (Index start = 0; start < size; start += runLength) {
+		Index length = std::min(runLength, size - start);
+		copyPixelArray(pixelArr + start, run, length);
+		std::sort(run, run + length, [](const Pixel<Index>& a, const Pixel<Index>& b) { return a.position < b.position; });
+		for (Index i = 0; i < length; i++) {
+			printOperation(ctx, "ext merge ");
+			updatePixel(pixelArr, rgb, run[i], start + i, size, ctx);
+		}
+	}
+	delete[] run;
+	trackFree(MEM_SCRATCH, (long long)runLength * sizeof(Pixel<Index>));
+	if (runLength == size) {
+		return;
+	}
+
+	MappedFile scratchFile;
+	Pixel<Index>* scratch = allocExternalScratch(size, &scratchFile, ctx);
+	for (long long width = runLength; width < size; width *= EXT_MERGE_WAYS) {
+		for (long long start = 0; start < size; start += width * EXT_MERGE_WAYS) {
+			long long end = std::min((long long)size, start + width * EXT_MERGE_WAYS);
+			copyPixelArray(pixelArr + start, scratch + start, (Index)(end - start));
+			extMergeGroup(pixelArr, rgb, scratch, size, start, end, width, ctx);
+			//merged back, this part of the scratch isn't read again this pass
+			if (scratchFile.Data()) {
+				scratchFile.Advise(MAP_ADVICE_DONTNEED, (size_t)start * sizeof(Pixel<Index>), (size_t)(end - start) * sizeof(Pixel<Index>));
+			}
+		}
+	}
+	freeExternalScratch(scratch, size, &scratchFile);
+}
+
+//base 256 digits blockRadixSort needs for the positions of size pixels
+int blockRadixPasses(long long size) {
+	int passes = 1;
+	while (passes < 8 && ((unsigned long long)(size - 1) >> (8 * passes)) != 0) {
+		passes++;
+	}
+	return passes;
+}
+
+//lsd radix sort by bytes of the position: each pass streams a copy of the array in
+//the scratch into EXT_BLOCK_PIXELS blocks per bucket, and a full block is written to
+//its bucket in one go, so the writes go to 256 places in runs instead of anywhere
+template <typename Index>
+void blockRadixSort(Pixel<Index>* pixelArr, uint8_t* rgb, Index size, RenderContext* ctx) {
+	MappedFile scratchFile;
+	Pixel<Index>* scratch = allocExternalScratch(size, &scratchFile, ctx);
+	trackAlloc(MEM_SCRATCH, 256LL * EXT_BLOCK_PIXELS * sizeof(Pixel<Index>));
+	Pixel<Index>* blocks = new Pixel<Index>[256 * EXT_BLOCK_PIXELS];
+	Index next[256];
+	int filled[256];
+
+	int passes = blockRadixPasses(size);
+	for (int pass = 0; pass < passes; pass++) {
+		int shift = 8 * pass;
+		//where every bucket starts
+		for (int b = 0; b < 256; b++) {
+			next[b] = 0;
+			filled[b] = 0;
+		}
+		for (Index i = 0; i < size; i++) {
+			next[(pixelArr[i].position >> shift) & 255]++;
+		}
+		Index total = 0;
+		for (int b = 0; b < 256; b++) {
+			Index count = next[b];
+			next[b] = total;
+			total += count;
+		}
+
+		//a full block goes to its bucket, what's left in the blocks after the last pixel
+		auto flush = [&](int b) {
+			for (int j = 0; j < filled[b]; j++) {
+				printOperation(ctx, "block radix ");
+				updatePixel(pixelArr, rgb, blocks[b * EXT_BLOCK_PIXELS + j], next[b]++, size, ctx);
+			}
+			filled[b] = 0;
+		};
+		copyPixelArray(pixelArr, scratch, size);
+		for (Index i = 0; i < size; i++) {
+			int b = (int)((scratch[i].position >> shift) & 255);
+			blocks[b * EXT_BLOCK_PIXELS + filled[b]++] = scratch[i];
+			if (filled[b] == EXT_BLOCK_PIXELS) {
+				flush(b);
+			}
+		}
+		for (int b = 0; b < 256; b++) {
+			flush(b);
+		}
+		if (scratchFile.Data()) {
+			scratchFile.Advise(MAP_ADVICE_DONTNEED);
+		}
 	}
+
+	delete[] blocks;
+	trackFree(MEM_SCRATCH, 256LL * EXT_BLOCK_PIXELS * sizeof(Pixel<Index>));
+	freeExternalScratch(scratch, size, &scratchFile);
 }
 
 
 
+/*----------------------------------------------------------------------PREPROCESSING--------------------------------------------------------------------*/
+
+//the biggest size with at most maxPixels pixels and (about) the image's aspect ratio
+void shrunkSize(int width, int height, long long maxPixels, int* newWidth, int* newHeight) {
+	double scale = sqrt((double)maxPixels / ((double)width * height));
+	*newWidth = std::max(1, std::min(width, (int)(width * scale)));
+	*newHeight = std::max(1, std::min(height, (int)(height * scale)));
+	while ((long long)*newWidth * *newHeight > maxPixels && (*newWidth > 1 || *newHeight > 1)) {
+		if (*newWidth >= *newHeight) {
+			(*newWidth)--;
+		}
+		else {
+			(*newHeight)--;
+		}
+	}
+}
+
+//where every pixel of a row (or column) of length goes in one of newLength: pixel i
+//spans i * newLength to (i + 1) * newLength and new pixel j spans j * length to
+//(j + 1) * length, so a pixel gives split of its newLength to first[i] and the rest
+//to the next one, when it straddles the border
+void downsampleSpans(int length, int newLength, std::vector<int>* first, std::vector<uint32_t>* split) {
+	first->resize(length);
+	split->resize(length);
+	for (int i = 0; i < length; i++) {
+		long long start = (long long)i * newLength;
+		long long j = start / length;
+		long long border = (j + 1) * length;
+		(*first)[i] = (int)j;
+		(*split)[i] = (uint32_t)(start + newLength <= border ? newLength : border - start);
+	}
+}
+
+//area average of rgb down to newWidth x newHeight: every new pixel is the mean of the
+//part of the image it covers, a pixel on a border counting toward both sides by how
+//much of it is on each. one pass over the image in integers, so it comes out the
+//same on every machine (the hash sink stays comparable)
+uint8_t* downsampleRGB(const uint8_t* rgb, int width, int height, int newWidth, int newHeight) {
+	std::vector<int> firstX, firstY;
+	std::vector<uint32_t> splitX, splitY;
+	downsampleSpans(width, newWidth, &firstX, &splitX);
+	downsampleSpans(height, newHeight, &firstY, &splitY);
+
+	long long bytes = (long long)newWidth * newHeight * 3;
+	trackAlloc(MEM_IMAGE, bytes);
+	//freed by freeImage like the images stb_image loads
+	uint8_t* small = (uint8_t*)STBI_MALLOC((size_t)bytes);
+	if (!small) {
+		trackFree(MEM_IMAGE, bytes);
+		throw std::runtime_error("out of memory shrinking the image");
+	}
+	//the row being filled in and the one the straddling rows already start on
+	std::vector<uint64_t> rowSums(newWidth * 3), current(newWidth * 3, 0), next(newWidth * 3, 0);
+	uint64_t total = (uint64_t)width * height;
+	int row = 0;
+	for (int y = 0; y < height; y++) {
+		std::fill(rowSums.begin(), rowSums.end(), 0);
+		const uint8_t* source = rgb + (size_t)y * width * 3;
+		for (int x = 0; x < width; x++) {
+			uint64_t* sum = &rowSums[firstX[x] * 3];
+			uint32_t weight = splitX[x];
+			sum[0] += source[x * 3] * weight;
+			sum[1] += source[x * 3 + 1] * weight;
+			sum[2] += source[x * 3 + 2] * weight;
+			if (weight < (uint32_t)newWidth) {
+				weight = newWidth - weight;
+				sum[3] += source[x * 3] * weight;
+				sum[4] += source[x * 3 + 1] * weight;
+				sum[5] += source[x * 3 + 2] * weight;
+			}
+		}
+		uint32_t weight = splitY[y];
+		for (int i = 0; i < newWidth * 3; i++) {
+			current[i] += rowSums[i] * weight;
+		}
+		if (weight < (uint32_t)newHeight) {
+			for (int i = 0; i < newWidth * 3; i++) {
+				next[i] += rowSums[i] * (newHeight - weight);
+			}
+		}
+		//the new row is done when the next image row starts on another one
+		if (y + 1 == height || firstY[y + 1] != row) {
+			uint8_t* out = small + (size_t)row * newWidth * 3;
+			for (int i = 0; i < newWidth * 3; i++) {
+				out[i] = (uint8_t)((current[i] + total / 2) / total);
+			}
+			current.swap(next);
+			std::fill(next.begin(), next.end(), 0);
+			row++;
+		}
+	}
+	return small;
+}
+
+//the preprocessing stage between loading the image and sorting it: replaces *rgb with
+//the image shrunk to at most maxPixels pixels (0 for no limit), so the sorts have fewer
+//pixels to go through. false if it was small enough already, report says how it changed
+bool shrinkImage(uint8_t** rgb, int* width, int* height, long long maxPixels, std::string* report) {
+	if (maxPixels <= 0 || (long long)*width * *height <= maxPixels) {
+		return false;
+	}
+	int newWidth, newHeight;
+	shrunkSize(*width, *height, maxPixels, &newWidth, &newHeight);
+	uint8_t* small = downsampleRGB(*rgb, *width, *height, newWidth, newHeight);
+	*report = std::to_string(*width) + "x" + std::to_string(*height) + " (" + std::to_string((long long)*width * *height) + " pixels) shrunk to "
+		+ std::to_string(newWidth) + "x" + std::to_string(newHeight) + " (" + std::to_string((long long)newWidth * newHeight) + " pixels)";
+	freeImage(*rgb, (long long)*width * *height);
+	*rgb = small;
+	*width = newWidth;
+	*height = newHeight;
+	return true;
+}
+
+
+/*----------------------------------------------------------------------BENCHMARK--------------------------------------------------------------------------*/
+
+//one row of the baseline file, times are in milliseconds
+struct BenchResult {
+	std::string algorithm;
+	int n;
+	std::string config;
+	std::string commit;
+	int runs;
+	double median;
+	double mad;
+};
+
+//throws away everything written to it, so the per operation prints
+//still get formatted while timing, but don't flood the console
+class NullBuffer : public std::streambuf {
+protected:
+	int overflow(int c) { return c; }
+};
+
+double medianOf(std::vector<double> values) {
+	std::sort(values.begin(), values.end());
+	size_t mid = values.size() / 2;
+	if (values.size() % 2 == 0) {
+		return (values[mid - 1] + values[mid]) / 2.0;
+	}
+	return values[mid];
+}
+
+//median absolute deviation, a spread measure that isn't thrown off by one slow run
+double madOf(const std::vector<double>& values) {
+	double median = medianOf(values);
+	std::vector<double> deviations;
+	for (size_t i = 0; i < values.size(); i++) {
+		deviations.push_back(fabs(values[i] - median));
+	}
+	return medianOf(deviations);
+}
+
+//same shuffle for every run (and every build) so the timings are comparable
+void shuffleSeeded(Pixel<int>* pixelArr, uint8_t* rgb, int size, unsigned int seed) {
+	std::mt19937 rng(seed);
+	for (int i = size - 1; i > 0; i--) {
+		int randIndex = rng() % (i + 1);
+		Pixel<int> tempPixel = pixelArr[i];
+		pixelArr[i] = pixelArr[randIndex];
+		pixelArr[randIndex] = tempPixel;
+		updateSingleRGB(pixelArr, rgb, i);
+		updateSingleRGB(pixelArr, rgb, randIndex);
+	}
+}
+
+BenchResult summarize(const std::string& algorithm, int n, const std::string& config, const std::string& commit, const std::vector<double>& times) {
+	BenchResult result;
+	result.algorithm = algorithm;
+	result.n = n;
+	result.config = config;
+	result.commit = commit;
+	result.runs = times.size();
+	result.median = medianOf(times);
+	result.mad = madOf(times);
+	return result;
+}
+
+//times a sort on a shuffled copy of the image, frames go to a NullCapture
+BenchResult benchSort(const std::string& algorithm, uint8_t* rgb, int size, unsigned int skip, int runs, const std::string& config, const std::string& commit) {
+	std::vector<double> times;
+	trackAlloc(MEM_IMAGE, (long long)size * 3);
+	uint8_t* work = new uint8_t[size * 3];
+	NullCapture capture;
+	NullBuffer nullBuf;
+
+	for (int r = 0; r < runs; r++) {
+		memcpy(work, rgb, size * 3);
+		Pixel<int>* pixelArray = getOrderedPixelFromRBG(work, size);
+		shuffleSeeded(pixelArray, work, size, BENCH_SEED + r);
+		RenderContext ctx;
+		ctx.skip = skip;
+		ctx.capture = &capture;
+
+		std::streambuf* consoleBuf = std::cout.rdbuf(&nullBuf);
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		runAction(algorithm, pixelArray, work, size, DEFAULT_FPS, &ctx);
+		std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+		std::cout.rdbuf(consoleBuf);
+
+		times.push_back(std::chrono::duration<double, std::milli>(end - start).count());
+		freePixelArray(pixelArray, size);
+	}
+
+	delete[] work;
+	trackFree(MEM_IMAGE, (long long)size * 3);
+	return summarize(algorithm, size, config, commit, times);
+}
+
+//times VideoCapture::AddFrame per frame, the image is partly reshuffled between
+//frames so the encoder sees changing content like it would during a sort
+BenchResult benchAddFrame(uint8_t* rgb, int width, int height, int runs, const std::string& config, const std::string& commit) {
+	int size = width * height;
+	std::vector<double> times;
+	trackAlloc(MEM_IMAGE, (long long)size * 3);
+	uint8_t* work = new uint8_t[size * 3];
+
+	for (int r = 0; r < runs; r++) {
+		memcpy(work, rgb, size * 3);
+		Pixel<int>* pixelArray = getOrderedPixelFromRBG(work, size);
+		std::mt19937 rng(BENCH_SEED + r);
+
+		VideoCapture capture;
+		capture.SetOutput("bench_tmp.h264", "bench_tmp.mp4");
+		capture.Init(width, height, DEFAULT_FPS, DEFAULT_BITRATE);
+
+		double total = 0;
+		for (int f = 0; f < BENCH_FRAMES; f++) {
+			for (int i = 0; i < size / BENCH_FRAMES; i++) {
+				int index1 = rng() % size;
+				int index2 = rng() % size;
+				Pixel<int> tempPixel = pixelArray[index1];
+				pixelArray[index1] = pixelArray[index2];
+				pixelArray[index2] = tempPixel;
+				updateSingleRGB(pixelArray, work, index1);
+				updateSingleRGB(pixelArray, work, index2);
+			}
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			capture.AddFrame(work);
+			std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+			total += std::chrono::duration<double, std::milli>(end - start).count();
+		}
+		capture.Finish();
+		times.push_back(total / BENCH_FRAMES);
+		freePixelArray(pixelArray, size);
+	}
+
+	remove("bench_tmp.h264");
+	remove("bench_tmp.mp4");
+	delete[] work;
+	trackFree(MEM_IMAGE, (long long)size * 3);
+	return summarize("addframe", size, config, commit, times);
+}
+
+//times packing the image into a pixel array (pack) and the colors back out of it
+//(unpack) with one level of the kernels, on one thread so the levels compare
+//loop to loop. *wrong is set if the output isn't the scalar loop's
+BenchResult benchKernel(bool pack, SimdLevel level, uint8_t* rgb, int size, int runs, const std::string& config, const std::string& commit, bool* wrong) {
+	std::vector<double> times;
+	trackAlloc(MEM_SCRATCH, (long long)size * (sizeof(Pixel<int>) + 3));
+	std::vector<Pixel<int> > pixels(size), expected(size);
+	std::vector<uint8_t> out(size * 3);
+	packPixels<int>(rgb, expected.data(), 0, size);
+	packPixels(rgb, pixels.data(), 0, size, level);
+
+	for (int r = 0; r < runs; r++) {
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		for (int pass = 0; pass < KERNEL_BENCH_PASSES; pass++) {
+			if (pack) {
+				packPixels(rgb, pixels.data(), 0, size, level);
+			}
+			else {
+				unpackPixels(pixels.data(), out.data(), size, level);
+			}
+		}
+		std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+		times.push_back(std::chrono::duration<double, std::milli>(end - start).count() / KERNEL_BENCH_PASSES);
+	}
+	*wrong = !pack && memcmp(out.data(), rgb, (size_t)size * 3) != 0;
+	//field by field, the scalar loop leaves the padding byte to the compiler
+	for (int i = 0; pack && i < size; i++) {
+		*wrong = *wrong || pixels[i].r != expected[i].r || pixels[i].g != expected[i].g || pixels[i].b != expected[i].b || pixels[i].position != expected[i].position;
+	}
+	trackFree(MEM_SCRATCH, (long long)size * (sizeof(Pixel<int>) + 3));
+	return summarize(std::string(pack ? "pack-" : "unpack-") + simdLevelName(level), size, config, commit, times);
+}
+
+//the biggest difference between the first columns x rows of two planes
+int planeDifference(const std::vector<uint8_t>& a, const std::vector<uint8_t>& b, int linesize, int columns, int rows) {
+	int most = 0;
+	for (int y = 0; y < rows; y++) {
+		for (int x = 0; x < columns; x++) {
+			size_t i = (size_t)y * linesize + x;
+			most = std::max(most, abs((int)a[i] - (int)b[i]));
+		}
+	}
+	return most;
+}
+
+//times the rgb to yuv420p conversion AddFrame does at the video's size with one level
+//of the converter, on one thread. *wrong is set if it isn't what the scalar loop gives,
+//or more than 1 off swscale's (when swscale can be set up) with any of the matrices
+//and ranges the video can be converted with. swscale's area filter averages the same 2x2 blocks for chroma, a half block at an
+//odd edge is left out, swscale doesn't repeat the last pixel there like y4m does
+BenchResult benchConvert(SimdLevel level, uint8_t* rgb, int width, int height, int runs, const std::string& config, const std::string& commit, bool* wrong) {
+	int chromaWidth = (width + 1) / 2;
+	int chromaHeight = (height + 1) / 2;
+	long long bytes = (long long)width * height + 2LL * chromaWidth * chromaHeight;
+	trackAlloc(MEM_SCRATCH, bytes * 2);
+	std::vector<uint8_t> planes[3], expected[3];
+	planes[0].resize((size_t)width * height);
+	planes[1].resize((size_t)chromaWidth * chromaHeight);
+	planes[2].resize((size_t)chromaWidth * chromaHeight);
+	uint8_t* planePointers[3] = { planes[0].data(), planes[1].data(), planes[2].data() };
+	int linesizes[3] = { width, chromaWidth, chromaWidth };
+
+	YuvConverter converter;
+	converter.SetLevel(SIMD_SCALAR);
+	converter.Convert(rgb, width, height, planePointers, linesizes);
+	for (int i = 0; i < 3; i++) {
+		expected[i] = planes[i];
+	}
+	converter.SetLevel(level);
+
+	std::vector<double> times;
+	for (int r = 0; r < runs; r++) {
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		for (int pass = 0; pass < KERNEL_BENCH_PASSES; pass++) {
+			//a band at a time, so the pool stays out of it
+			for (int row = 0; row < height; row += YUV_BAND_ROWS) {
+				uint8_t* band[3] = { planePointers[0] + (size_t)row * width, planePointers[1] + (size_t)row / 2 * chromaWidth, planePointers[2] + (size_t)row / 2 * chromaWidth };
+				converter.Convert(rgb + (size_t)row * width * 3, width, std::min(YUV_BAND_ROWS, height - row), band, linesizes);
+			}
+		}
+		std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+		times.push_back(std::chrono::duration<double, std::milli>(end - start).count() / KERNEL_BENCH_PASSES);
+	}
+	*wrong = planes[0] != expected[0] || planes[1] != expected[1] || planes[2] != expected[2];
+
+	//planes gets swscale's frame, expected the scalar loop's with the same colors
+	for (int colors = 0; level == SIMD_SCALAR && colors < 4; colors++) {
+		YuvMatrix matrix = colors / 2 ? YUV_BT709 : YUV_BT601;
+		bool fullRange = colors % 2 != 0;
+		SwsContext* sws = sws_getContext(width, height, AV_PIX_FMT_RGB24, width, height, AV_PIX_FMT_YUV420P, SWS_AREA, 0, 0, 0);
+		if (!sws) {
+			break;
+		}
+		const int* coefficients = sws_getCoefficients(matrix == YUV_BT709 ? SWS_CS_ITU709 : SWS_CS_ITU601);
+		sws_setColorspaceDetails(sws, coefficients, 1, coefficients, fullRange ? 1 : 0, 0, 1 << 16, 1 << 16);
+		int inLinesize[1] = { 3 * width };
+		sws_scale(sws, (const uint8_t * const *)&rgb, inLinesize, 0, height, planePointers, linesizes);
+		sws_freeContext(sws);
+		uint8_t* expectedPointers[3] = { expected[0].data(), expected[1].data(), expected[2].data() };
+		converter.SetColors(matrix, fullRange);
+		converter.Convert(rgb, width, height, expectedPointers, linesizes);
+
+		int luma = planeDifference(planes[0], expected[0], width, width, height);
+		int chroma = std::max(planeDifference(planes[1], expected[1], chromaWidth, width / 2, height / 2),
+			planeDifference(planes[2], expected[2], chromaWidth, width / 2, height / 2));
+		std::cout << ">> converter vs swscale, " << (matrix == YUV_BT709 ? "bt709" : "bt601") << (fullRange ? " full" : " limited")
+			<< ": luma within " << luma << ", chroma within " << chroma << "." << std::endl;
+		*wrong = *wrong || luma > 1 || chroma > 1;
+	}
+	trackFree(MEM_SCRATCH, bytes * 2);
+	return summarize(std::string("convert-") + simdLevelName(level), width * height, config, commit, times);
+}
+
+std::vector<BenchResult> readBaseline(const char* fileName) {
+	std::vector<BenchResult> rows;
+	std::ifstream file(fileName);
+	std::string line;
+	std::getline(file, line); //header
+	while (std::getline(file, line)) {
+		std::stringstream lineStream(line);
+		std::string field;
+		std::vector<std::string> fields;
+		while (std::getline(lineStream, field, ',')) {
+			fields.push_back(field);
+		}
+		if (fields.size() < 7) {
+			continue;
+		}
+		BenchResult row;
+		row.algorithm = fields[0];
+		row.n = atoi(fields[1].c_str());
+		row.config = fields[2];
+		row.commit = fields[3];
+		row.runs = atoi(fields[4].c_str());
+		row.median = atof(fields[5].c_str());
+		row.mad = atof(fields[6].c_str());
+		rows.push_back(row);
+	}
+	return rows;
+}
+
+void writeBaseline(const char* fileName, const std::vector<BenchResult>& rows) {
+	std::ofstream file(fileName);
+	file << "algorithm,n,config,commit,runs,median_ms,mad_ms\n";
+	for (size_t i = 0; i < rows.size(); i++) {
+		file << rows[i].algorithm << ',' << rows[i].n << ',' << rows[i].config << ',' << rows[i].commit << ','
+			<< rows[i].runs << ',' << rows[i].median << ',' << rows[i].mad << '\n';
+	}
+}
+
+//newest baseline row measured the same way as result, NULL if there is none
+const BenchResult* findBaseline(const std::vector<BenchResult>& rows, const BenchResult& result) {
+	for (size_t i = rows.size(); i > 0; i--) {
+		const BenchResult& row = rows[i - 1];
+		if (row.algorithm == result.algorithm && row.n == result.n && row.config == result.config) {
+			return &row;
+		}
+	}
+	return NULL;
+}
+
+//a run only counts as a regression if it is slower by more than the tolerance
+//and by more than the noise seen in either set of runs
+bool isRegression(const BenchResult& baseline, const BenchResult& result) {
+	double allowed = baseline.median * BENCH_TOLERANCE;
+	double noise = BENCH_NOISE_MADS * 1.4826 * std::max(baseline.mad, result.mad);
+	return result.median - baseline.median > std::max(allowed, noise);
+}
+
+bool isValidBenchMode(const std::string& mode) {
+	return mode == "run" || mode == "save" || mode == "check";
+}
+
+//mode is "run" (just print), "save" (store as the baseline for commit) or "check"
+//(compare against the stored baseline), returns 1 if check found a regression
+int runBenchmark(uint8_t* rgb, int width, int height, const std::string& mode, const std::string& commit, int runs) {
+	int size = width * height;
+	unsigned int skip = width + height;
+	std::string config = "skip=" + std::to_string(skip) + ";fps=" + std::to_string(DEFAULT_FPS) + ";bitrate=" + std::to_string(DEFAULT_BITRATE);
+
+	const char* sorts[] = { "quick", "merge", "heapMax", "heapMin", "counting", "radix", "extmerge", "blockradix", "reverse", "bubble" };
+	std::vector<BenchResult> results;
+	for (size_t i = 0; i < sizeof(sorts) / sizeof(sorts[0]); i++) {
+		if (std::string(sorts[i]) == "bubble" && size > BENCH_BUBBLE_LIMIT) {
+			continue;
+		}
+		std::cout << ">> timing " << sorts[i] << "..." << std::endl;
+		results.push_back(benchSort(sorts[i], rgb, size, skip, runs, config, commit));
+	}
+	std::cout << ">> timing addframe..." << std::endl;
+	results.push_back(benchAddFrame(rgb, width, height, runs, config, commit));
+	bool regressed = false;
+	for (int level = SIMD_SCALAR; level <= simdLevel(); level++) {
+		std::cout << ">> timing pixel kernels (" << simdLevelName((SimdLevel)level) << ")..." << std::endl;
+		for (int pack = 1; pack >= 0; pack--) {
+			bool wrong;
+			results.push_back(benchKernel(pack != 0, (SimdLevel)level, rgb, size, runs, config, commit, &wrong));
+			if (wrong) {
+				std::cout << ">> " << results.back().algorithm << " doesn't match the scalar loop." << std::endl;
+				regressed = true;
+			}
+		}
+		bool wrong;
+		results.push_back(benchConvert((SimdLevel)level, rgb, width, height, runs, config, commit, &wrong));
+		if (wrong) {
+			std::cout << ">> " << results.back().algorithm << " doesn't match the scalar loop or swscale." << std::endl;
+			regressed = true;
+		}
+	}
+
+	std::vector<BenchResult> baseline = readBaseline(BENCH_BASELINE_FILE);
+
+	std::cout << "-------------------------------------------------------------------------------------" << std::endl;
+	std::cout << "algorithm     n          median ms    mad ms       baseline ms  change" << std::endl;
+	for (size_t i = 0; i < results.size(); i++) {
+		const BenchResult& result = results[i];
+		printf("%-13s %-10d %-12.3f %-12.3f ", result.algorithm.c_str(), result.n, result.median, result.mad);
+		const BenchResult* base = findBaseline(baseline, result);
+		if (!base) {
+			printf("%-12s\n", "-");
+			continue;
+		}
+		printf("%-12.3f %+.1f%%", base->median, 100.0 * (result.median - base->median) / base->median);
+		if (mode == "check" && isRegression(*base, result)) {
+			printf("  REGRESSION (baseline %s)", base->commit.c_str());
+			regressed = true;
+		}
+		printf("\n");
+	}
+	std::cout << "-------------------------------------------------------------------------------------" << std::endl;
+
+	if (mode == "save") {
+		//replace any rows already stored for this commit
+		std::vector<BenchResult> kept;
+		for (size_t i = 0; i < baseline.size(); i++) {
+			bool replaced = false;
+			for (size_t j = 0; j < results.size(); j++) {
+				if (baseline[i].algorithm == results[j].algorithm && baseline[i].n == results[j].n && baseline[i].config == results[j].config && baseline[i].commit == results[j].commit) {
+					replaced = true;
+				}
+			}
+			if (!replaced) {
+				kept.push_back(baseline[i]);
+			}
+		}
+		kept.insert(kept.end(), results.begin(), results.end());
+		writeBaseline(BENCH_BASELINE_FILE, kept);
+		std::cout << ">> Baseline saved for " << commit << "." << std::endl;
+	}
+	return regressed ? 1 : 0;
+}
+
+
+
+/*----------------------------------------------------------------------PLANNER--------------------------------------------------------------------------*/
+
+//the newest counting/addframe rows of the benchmark baseline as the cost model, the
+//defaults if there are none
+PlanCostModel loadPlanCalibration() {
+	PlanCostModel cost;
+	std::vector<BenchResult> baseline = readBaseline(BENCH_BASELINE_FILE);
+	for (size_t i = 0; i < baseline.size(); i++) {
+		//counting sort does exactly one operation per pixel
+		if (baseline[i].algorithm == "counting" && baseline[i].n > 0) {
+			cost.nsPerOperation = baseline[i].median * 1e6 / baseline[i].n;
+			cost.calibrated = true;
+		}
+		if (baseline[i].algorithm == "addframe" && baseline[i].n > 0) {
+			cost.nsPerPixel = baseline[i].median * 1e6 / baseline[i].n;
+			cost.calibrated = true;
+		}
+	}
+	return cost;
+}
+
+//the most pixels the actions are estimated to sort and encode within seconds, 0 if the
+//whole image does. grows from a small size first, so the planner never simulates much
+//more than the answer, then narrows it down to a percent
+long long pixelsWithin(const std::vector<std::string>& actions, int width, int height, const SinkOptions& sink, unsigned int seed, double seconds, const PlanCostModel& cost) {
+	auto fits = [&](long long pixels) {
+		int planWidth, planHeight;
+		shrunkSize(width, height, pixels, &planWidth, &planHeight);
+		if (needsWideIndex((long long)planWidth * planHeight)) {
+			return false;
+		}
+		//the same estimate every time, whatever the render's shuffle
+		PlanSummary plan = planActions(actions, planWidth, planHeight, sink.fps, sink.bitrate, seed ? seed : 1, false, cost);
+		return plan.sortSeconds + plan.encodeSeconds <= seconds;
+	};
+	long long total = (long long)width * height;
+	long long low = 0, high = 1024;
+	while (high < total && fits(high)) {
+		low = high;
+		high *= 2;
+	}
+	if (high >= total) {
+		if (fits(total)) {
+			return 0;
+		}
+		high = total;
+	}
+	while (high - low > std::max(1LL, high / 100)) {
+		long long middle = low + (high - low) / 2;
+		if (fits(middle)) {
+			low = middle;
+		}
+		else {
+			high = middle;
+		}
+	}
+	return std::max(1LL, low);
+}
+
+//what to shrink the image to: maxPixels, or less if the time budget takes less, 0 for as it is
+long long pixelLimit(const std::vector<std::string>& actions, int width, int height, const SinkOptions& sink, unsigned int seed, long long maxPixels, double seconds, const PlanCostModel& cost) {
+	if (seconds > 0) {
+		long long within = pixelsWithin(actions, width, height, sink, seed, seconds, cost);
+		if (within && (!maxPixels || within < maxPixels)) {
+			maxPixels = within;
+		}
+	}
+	return maxPixels;
+}
+
+//times one counting sort and a few frames of encoding on this image
+void calibratePlan(uint8_t* rgb, int width, int height, PlanCostModel* cost) {
+	int size = width * height;
+	std::cout << ">> calibrating..." << std::endl;
+	BenchResult sortResult = benchSort("counting", rgb, size, width + height, 1, "", "");
+	BenchResult frameResult = benchAddFrame(rgb, width, height, 1, "", "");
+	cost->nsPerOperation = sortResult.median * 1e6 / size;
+	cost->nsPerPixel = frameResult.median * 1e6 / size;
+	cost->calibrated = true;
+}
+
+//bubble sort does exactly one swap per inversion, counted with a merge sort
+unsigned long long countInversions(std::vector<int>& values, std::vector<int>& temp, int left, int right) {
+	if (right - left < 1) {
+		return 0;
+	}
+	int mid = left + (right - left) / 2;
+	unsigned long long inversions = countInversions(values, temp, left, mid) + countInversions(values, temp, mid + 1, right);
+	int i = left, j = mid + 1, k = left;
+	while (i <= mid && j <= right) {
+		if (values[i] <= values[j]) {
+			temp[k++] = values[i++];
+		}
+		else {
+			inversions += mid - i + 1;
+			temp[k++] = values[j++];
+		}
+	}
+	while (i <= mid) {
+		temp[k++] = values[i++];
+	}
+	while (j <= right) {
+		temp[k++] = values[j++];
+	}
+	for (k = left; k <= right; k++) {
+		values[k] = temp[k];
+	}
+	return inversions;
+}
+
+//mergeSort writes every element once per merge, whatever the order
+unsigned long long mergeWrites(int length, std::map<int, unsigned long long>& known) {
+	if (length < 2) {
+		return 0;
+	}
+	if (known.count(length)) {
+		return known[length];
+	}
+	int leftLength = (length - 1) / 2 + 1;
+	unsigned long long writes = length + mergeWrites(leftLength, known) + mergeWrites(length - leftLength, known);
+	known[length] = writes;
+	return writes;
+}
+
+//same partitioning as quickSort, only counting its swaps, limit bounds the comparisons
+unsigned long long quickSwaps(std::vector<int>& values, unsigned long long limit, bool* gaveUp) {
+	unsigned long long swaps = 0, comparisons = 0;
+	std::vector<std::pair<int, int> > ranges;
+	ranges.push_back(std::make_pair(0, (int)values.size() - 1));
+	while (!ranges.empty()) {
+		int low = ranges.back().first;
+		int high = ranges.back().second;
+		ranges.pop_back();
+		if (low >= high) {
+			continue;
+		}
+		if (comparisons > limit) {
+			*gaveUp = true;
+			return swaps;
+		}
+		int pivot = values[high];
+		int leftInd = low - 1;
+		for (int i = low; i <= high - 1; i++) {
+			if (values[i] <= pivot) {
+				leftInd++;
+				std::swap(values[leftInd], values[i]);
+				swaps++;
+			}
+		}
+		std::swap(values[leftInd + 1], values[high]);
+		swaps++;
+		comparisons += high - low;
+		ranges.push_back(std::make_pair(leftInd + 2, high));
+		ranges.push_back(std::make_pair(low, leftInd));
+	}
+	return swaps;
+}
+
+//same sift down as siftDown/siftDownMin, only counting its swaps
+unsigned long long heapSwaps(std::vector<int>& values, bool maxHeap) {
+	unsigned long long swaps = 0;
+	int size = values.size();
+	for (int pass = 0; pass < 2; pass++) {
+		for (int i = (pass == 0 ? size / 2 - 1 : size - 1); i >= 0; i--) {
+			int heapSize = size;
+			int root = i;
+			if (pass == 1) {
+				//move root to end then sift the new root
+				std::swap(values[0], values[i]);
+				swaps++;
+				heapSize = i;
+				root = 0;
+			}
+			while (true) {
+				int best = root;
+				if (hasLeftChild(root, heapSize)) {
+					int left = getLeftChild(root), right = getRightChild(root);
+					if (maxHeap ? values[left] > values[root] : values[left] < values[root]) {
+						best = left;
+					}
+					if (hasRightChild(root, heapSize) && (maxHeap ? values[right] > values[best] : values[right] < values[best])) {
+						best = right;
+					}
+				}
+				if (best == root) {
+					break;
+				}
+				std::swap(values[root], values[best]);
+				swaps++;
+				root = best;
+			}
+		}
+	}
+	return swaps;
+}
+
+bool isSortedAscending(const std::vector<int>& values) {
+	for (size_t i = 1; i < values.size(); i++) {
+		if (values[i - 1] > values[i]) {
+			return false;
+		}
+	}
+	return true;
+}
+
+//frames added while the operation counter goes from counter to counter + operations
+unsigned long long framesBetween(unsigned long long counter, unsigned long long operations, unsigned long long skip) {
+	return (counter + operations) / skip - counter / skip;
+}
+
+//estimates every action of the list on an image of width x height, by running
+//counting-only versions of the sorts on plain positions (or closed forms where
+//that would take as long as the sort itself)
+PlanSummary planActions(const std::vector<std::string>& actions, int width, int height, int fps, int bitrate, unsigned int seed, bool print, const PlanCostModel& cost) {
+	PlanSummary summary;
+	summary.operations = 0;
+	summary.frames = 0;
+	summary.estimated = false;
+	summary.sortSeconds = 0;
+	summary.encodeSeconds = 0;
+	summary.outputBytes = 0;
+	summary.peakBytes = 0;
+	//the simulations run on int positions
+	if (needsWideIndex((long long)width * height)) {
+		if (print) {
+			std::cout << ">> The image is too big to plan, the estimates only go up to " << PIXEL_INDEX32_MAX << " pixels." << std::endl;
+		}
+		return summary;
+	}
+	int size = width * height;
+	unsigned long long skip = width + height;
+	unsigned long long counter = 0;
+	std::vector<int> values(size);
+	for (int i = 0; i < size; i++) {
+		values[i] = i;
+	}
+	std::mt19937 rng(seed ? seed : time(0));
+	std::map<int, unsigned long long> knownMerges;
+	long long scratchBytes = 0;
+
+	if (print) {
+		std::cout << "-------------------------------------------------------------------------------------" << std::endl;
+		std::cout << "action        operations        frames" << std::endl;
+	}
+	for (size_t a = 0; a < actions.size(); a++) {
+		const std::string& action = actions[a];
+		unsigned long long operations = 0, frames = 0;
+		bool estimated = false;
+
+		if (action == "shuffle" || action == "shuffleNoVid") {
+			operations = size;
+			std::shuffle(values.begin(), values.end(), rng);
+			frames = action == "shuffle" ? framesBetween(counter, operations, skip) : 0;
+		}
+		else if (action == "reverse") {
+			operations = size / 2;
+			std::reverse(values.begin(), values.end());
+			frames = framesBetween(counter, operations, skip);
+		}
+		else if (action == "delay") {
+			operations = fps;
+			frames = fps;
+		}
+		else {
+			if (action == "bubble") {
+				std::vector<int> temp(size);
+				operations = countInversions(values, temp, 0, size - 1);
+				frames = framesBetween(counter, operations, skip * 5);
+			}
+			else if (action == "quick") {
+				if (isSortedAscending(values)) {
+					//every partition swaps its whole range and peels off one element
+					operations = (unsigned long long)size * (size + 1) / 2 - 1;
+				}
+				else {
+					operations = quickSwaps(values, PLAN_SIM_LIMIT, &estimated);
+					if (estimated) {
+						operations = (unsigned long long)size * size / 2;
+					}
+				}
+			}
+			else if (action == "merge") {
+				operations = mergeWrites(size, knownMerges);
+				scratchBytes = std::max(scratchBytes, (long long)size * (long long)pixelBytes(size));
+			}
+			else if (action == "heapMax" || action == "heapMin") {
+				operations = heapSwaps(values, action == "heapMax");
+				if (action == "heapMin") {
+					operations += size / 2;
+				}
+			}
+			else if (action == "counting") {
+				operations = size;
+				scratchBytes = std::max(scratchBytes, (long long)size * (long long)(sizeof(int) + pixelBytes(size)));
+			}
+			else if (action == "radix") {
+				operations = (unsigned long long)size * getNumDigits(size);
+				scratchBytes = std::max(scratchBytes, (long long)size * (long long)pixelBytes(size) + 10 * (long long)sizeof(int));
+			}
+			else if (action == "extmerge") {
+				operations = (unsigned long long)size * extMergePasses(size);
+				scratchBytes = std::max(scratchBytes, (long long)size * (long long)pixelBytes(size));
+			}
+			else if (action == "blockradix") {
+				operations = (unsigned long long)size * blockRadixPasses(size);
+				scratchBytes = std::max(scratchBytes, ((long long)size + 256 * EXT_BLOCK_PIXELS) * (long long)pixelBytes(size));
+			}
+			if (action != "bubble") {
+				frames = framesBetween(counter, operations, skip);
+			}
+			//every sort leaves the pixels in order
+			for (int i = 0; i < size; i++) {
+				values[i] = i;
+			}
+		}
+
+		counter += operations;
+		summary.operations += operations;
+		summary.frames += frames;
+		summary.estimated = summary.estimated || estimated;
+		if (print) {
+			printf("%-13s %s%-16llu %llu\n", action.c_str(), estimated ? "~" : "", operations, frames);
+		}
+	}
+
+	long long frameBytes = (long long)size * 3 / 2;
+	summary.sortSeconds = summary.operations * cost.nsPerOperation / 1e9;
+	summary.encodeSeconds = summary.frames * size * cost.nsPerPixel / 1e9;
+	summary.outputBytes = (double)summary.frames / fps * bitrate * 1000 / 8;
+	summary.peakBytes = (long long)size * 3 + (long long)size * (long long)pixelBytes(size) + scratchBytes + frameBytes * (1 + PLAN_ENCODER_FRAMES);
+
+	if (print) {
+		std::cout << "-------------------------------------------------------------------------------------" << std::endl;
+		printf("total         %s%-16llu %llu (%.1f s of video)\n", summary.estimated ? "~" : "", summary.operations, summary.frames, (double)summary.frames / fps);
+		printf("sort time     %.1f s\n", summary.sortSeconds);
+		printf("encode time   %.1f s%s\n", summary.encodeSeconds, cost.calibrated ? "" : " (uncalibrated, run plan calibrate or bench save)");
+		printf("output size   %.2f MB\n", summary.outputBytes / 1048576.0);
+		printf("peak memory   %.2f MB\n", summary.peakBytes / 1048576.0);
+		if (memoryStats().budget > 0 && summary.peakBytes > memoryStats().budget) {
+			printf("              over the %.2f MB budget\n", memoryStats().budget / 1048576.0);
+		}
+		printf("plan: operations=%llu frames=%llu sort_s=%.1f encode_s=%.1f output_bytes=%.0f peak_bytes=%lld estimated=%d\n",
+			summary.operations, summary.frames, summary.sortSeconds, summary.encodeSeconds, summary.outputBytes, summary.peakBytes, summary.estimated ? 1 : 0);
+		std::cout << "-------------------------------------------------------------------------------------" << std::endl;
+	}
+	return summary;
+}
+
+
+
+/*----------------------------------------------------------------------CHECKPOINTS--------------------------------------------------------------------*/
+
+//why the sink's output can't be split into segments, empty if it can
+std::string checkpointProblem(const SinkOptions& sink) {
+	if (sink.type != "video" && sink.type != "hash" && sink.type != "y4m" && sink.type != "yuv420p" && sink.type != "rgb24") {
+		return "checkpoints need the video, hash, y4m, yuv420p or rgb24 sink";
+	}
+	if (sink.fileName == "-") {
+		return "a checkpointed render can't write to stdout";
+	}
+	if (sink.fragmentFrames || !sink.renditions.empty() || !sink.statsFile.empty()) {
+		return "checkpoints can't be combined with fragment, rendition or stats";
+	}
+	if (sink.viewWidth > 0) {
+		return "checkpoints can't be combined with a viewport, where it was isn't saved";
+	}
+	return "";
+}
+
+//segment n of the output, video segments are raw h264 until they're joined
+std::string segmentFileName(const Checkpoint& cp, int segment) {
+	return sinkFileName(cp.sink) + ".seg" + std::to_string(segment) + (cp.sink.type == "video" ? ".h264" : "");
+}
+
+//a capture for the next segment
+CaptureSink* createSegment(const Checkpoint& cp, Logger* logger) {
+	std::string segmentName = segmentFileName(cp, cp.segments);
+	if (cp.sink.type != "video") {
+		SinkOptions options = cp.sink;
+		options.fileName = segmentName;
+		return createSink(options, cp.width, cp.height, logger);
+	}
+	//just the raw stream, the remux waits for every segment
+	VideoCapture* video = new VideoCapture();
+	video->SetOutput(segmentName, "");
+	video->SetOutputSize(cp.sink.fitWidth, cp.sink.fitHeight);
+	video->SetColors(cp.sink.colorMatrix, cp.sink.fullRange);
+	video->SetLogger(logger);
+	video->Init(cp.width, cp.height, cp.sink.fps, cp.sink.bitrate);
+	return video;
+}
+
+//puts the segments back together into the output, as if it was written in one go
+bool joinSegments(const Checkpoint& cp, Logger* logger) {
+	const SinkOptions& sink = cp.sink;
+	std::string output = sinkFileName(sink);
+	//video segments are joined into the raw stream the remux normally reads
+	std::string joinedName = sink.type != "video" ? output : sink.fileName.empty() ? "tmp.h264" : sink.fileName + ".tmp.h264";
+	FILE* joined = fopen(joinedName.c_str(), "wb");
+	if (!joined) {
+		logger->Debug("Failed to open " + joinedName + " to join the checkpoint segments", 0);
+		return false;
+	}
+	bool ok = true;
+	int frame = 0;
+	std::vector<char> buffer(1 << 16);
+	for (int i = 0; i < cp.segments && ok; i++) {
+		FILE* segment = fopen(segmentFileName(cp, i).c_str(), "rb");
+		if (!segment) {
+			logger->Debug("Missing checkpoint segment " + segmentFileName(cp, i), 0);
+			ok = false;
+			break;
+		}
+		if (sink.type == "hash") {
+			//every segment has its own header and numbers its frames from 0
+			char line[256];
+			unsigned long long hash;
+			while (fgets(line, sizeof(line), segment)) {
+				if (line[0] == '#') {
+					if (i == 0) {
+						fputs(line, joined);
+					}
+				}
+				else if (sscanf(line, "%*d %llx", &hash) == 1) {
+					fprintf(joined, "%d %016llx\n", frame++, hash);
+				}
+			}
+		}
+		else {
+			//so does every y4m segment, only the first one is kept
+			if (sink.type == "y4m" && i > 0) {
+				int c;
+				while ((c = fgetc(segment)) != EOF && c != '\n');
+			}
+			size_t bytes;
+			while (ok && (bytes = fread(buffer.data(), 1, buffer.size(), segment)) > 0) {
+				ok = fwrite(buffer.data(), 1, bytes, joined) == bytes;
+			}
+		}
+		fclose(segment);
+	}
+	if (fclose(joined) != 0 || !ok) {
+		logger->Debug("Failed to join the checkpoint segments into " + joinedName, 0);
+		return false;
+	}
+	if (sink.type == "video") {
+		VideoCapture video;
+		video.SetLogger(logger);
+		video.SetOutput(joinedName, output);
+		video.RemuxStream(sink.fps);
+	}
+	for (int i = 0; i < cp.segments; i++) {
+		remove(segmentFileName(cp, i).c_str());
+	}
+	return true;
+}
+
+//a new checkpoint for the render, or the one a crashed run of the same render left in fileName
+bool startCheckpoint(const std::string& fileName, int interval, const std::string& image, const std::vector<std::string>& actions, const SinkOptions& sink, unsigned int seed, long long maxPixels, int width, int height, Checkpoint* cp, std::string* error) {
+	if (!(*error = checkpointProblem(sink)).empty()) {
+		return false;
+	}
+	FILE* existing = fopen(fileName.c_str(), "rb");
+	if (existing) {
+		fclose(existing);
+		if (!loadCheckpoint(fileName, cp, error)) {
+			return false;
+		}
+		if (cp->image != image || cp->actions != actions || sinkFileName(cp->sink) != sinkFileName(sink) || cp->sink.type != sink.type
+			|| cp->sink.fitWidth != sink.fitWidth || cp->sink.fitHeight != sink.fitHeight || cp->sink.colorMatrix != sink.colorMatrix || cp->sink.fullRange != sink.fullRange
+			|| cp->maxPixels != maxPixels || (seed && seed != cp->seed)) {
+			*error = fileName + " is the checkpoint of another render";
+			return false;
+		}
+		if (cp->width != width || cp->height != height) {
+			*error = image + " changed since " + fileName + " was saved";
+			return false;
+		}
+	}
+	else {
+		cp->image = image;
+		cp->actions = actions;
+		cp->sink = sink;
+		cp->maxPixels = maxPixels;
+		cp->width = width;
+		cp->height = height;
+	}
+	cp->fileName = fileName;
+	cp->interval = interval > 0 ? interval : CHECKPOINT_DEFAULT_FRAMES;
+	return true;
+}
+
+void writeCheckpointString(FILE* file, const std::string& str) {
+	uint32_t length = (uint32_t)str.size();
+	fwrite(&length, sizeof(length), 1, file);
+	fwrite(str.data(), 1, length, file);
+}
+
+bool readCheckpointString(FILE* file, std::string* str) {
+	uint32_t length;
+	if (fread(&length, sizeof(length), 1, file) != 1 || length > 65536) {
+		return false;
+	}
+	str->resize(length);
+	return length == 0 || fread(&(*str)[0], 1, length, file) == length;
+}
+
+//the fields in the order they're stored, all 64 bit
+#define CHECKPOINT_FIELDS 16
+#define CHECKPOINT_MAGIC "SVCKPT5"
+
+//written next to the checkpoint and renamed over it, so a crash while saving keeps the last one
+bool saveCheckpoint(const Checkpoint& cp) {
+	std::string tmpName = cp.fileName + ".tmp";
+	FILE* file = fopen(tmpName.c_str(), "wb");
+	if (!file) {
+		return false;
+	}
+	uint64_t fields[CHECKPOINT_FIELDS] = { (uint64_t)cp.width, (uint64_t)cp.height, cp.seed, cp.skip, (uint64_t)cp.action, cp.actionStart, cp.operation,
+		(uint64_t)cp.segments, (uint64_t)cp.sink.fps, (uint64_t)cp.sink.bitrate, cp.actions.size(), cp.pixels.size(),
+		(uint64_t)cp.sink.fitWidth, (uint64_t)cp.sink.fitHeight, (uint64_t)cp.maxPixels, (uint64_t)cp.sink.colorMatrix | (uint64_t)cp.sink.fullRange << 8 };
+	fwrite(CHECKPOINT_MAGIC, 1, 8, file);
+	fwrite(fields, sizeof(uint64_t), CHECKPOINT_FIELDS, file);
+	writeCheckpointString(file, cp.image);
+	writeCheckpointString(file, cp.sink.type);
+	writeCheckpointString(file, cp.sink.fileName);
+	for (size_t i = 0; i < cp.actions.size(); i++) {
+		writeCheckpointString(file, cp.actions[i]);
+	}
+	bool ok = fwrite(cp.pixels.data(), 1, cp.pixels.size(), file) == cp.pixels.size();
+	if (fclose(file) != 0 || !ok) {
+		remove(tmpName.c_str());
+		return false;
+	}
+	//rename won't replace a file on windows
+	remove(cp.fileName.c_str());
+	return rename(tmpName.c_str(), cp.fileName.c_str()) == 0;
+}
+
+bool loadCheckpoint(const std::string& fileName, Checkpoint* cp, std::string* error) {
+	FILE* file = fopen(fileName.c_str(), "rb");
+	if (!file) {
+		*error = "couldn't open " + fileName;
+		return false;
+	}
+	char magic[8];
+	uint64_t fields[CHECKPOINT_FIELDS];
+	bool ok = fread(magic, 1, 8, file) == 8 && !memcmp(magic, CHECKPOINT_MAGIC, 8) && fread(fields, sizeof(uint64_t), CHECKPOINT_FIELDS, file) == CHECKPOINT_FIELDS;
+	if (ok) {
+		cp->width = (int)fields[0];
+		cp->height = (int)fields[1];
+		cp->seed = (unsigned int)fields[2];
+		cp->skip = (unsigned int)fields[3];
+		cp->action = (int)fields[4];
+		cp->actionStart = fields[5];
+		cp->operation = fields[6];
+		cp->segments = (int)fields[7];
+		cp->sink.fps = (int)fields[8];
+		cp->sink.bitrate = (int)fields[9];
+		cp->sink.fitWidth = (int)fields[12];
+		cp->sink.fitHeight = (int)fields[13];
+		cp->maxPixels = (long long)fields[14];
+		cp->sink.colorMatrix = (fields[15] & 0xFF) == YUV_BT709 ? YUV_BT709 : YUV_BT601;
+		cp->sink.fullRange = (fields[15] >> 8 & 1) != 0;
+		//the pixel array is as big as the image, checked before anything is allocated
+		ok = fields[0] < INT_MAX && fields[1] < INT_MAX && fields[10] > 0 && fields[10] < 65536 && fields[4] < fields[10]
+			&& fields[11] == fields[0] * fields[1] * pixelBytes((long long)(fields[0] * fields[1]));
+	}
+	ok = ok && readCheckpointString(file, &cp->image) && readCheckpointString(file, &cp->sink.type) && readCheckpointString(file, &cp->sink.fileName);
+	for (uint32_t i = 0; ok && i < fields[10]; i++) {
+		std::string action;
+		ok = readCheckpointString(file, &action) && isValidAction(action);
+		cp->actions.push_back(action);
+	}
+	if (ok) {
+		cp->pixels.resize(fields[11]);
+		ok = fread(cp->pixels.data(), 1, cp->pixels.size(), file) == cp->pixels.size();
+	}
+	fclose(file);
+	if (!ok || !checkpointProblem(cp->sink).empty()) {
+		*error = fileName + " isn't a checkpoint, or it's damaged";
+		return false;
+	}
+	return true;
+}
+
+//called after every frame of a checkpointed render, every interval frames it closes
+//the segment, saves the checkpoint and starts the next segment
+void checkpointRender(RenderContext* ctx) {
+	Checkpoint* cp = ctx->checkpoint;
+	if (++cp->framesSinceSave < cp->interval) {
+		return;
+	}
+	//the segment has to be on the disk before the checkpoint counts it
+	ctx->capture->Finish();
+	delete ctx->capture;
+	ctx->capture = NULL;
+	cp->segments++;
+	cp->operation = ctx->frameCount;
+	cp->framesSinceSave = 0;
+	if (!saveCheckpoint(*cp)) {
+		ctx->logger->Debug("Failed to save checkpoint " + cp->fileName, 0);
+	}
+	ctx->capture = createSegment(*cp, ctx->logger);
+}
+
+//runs the actions of cp from where it got to (the start for a new one) with checkpoints,
+//then joins the segments into the output. the checkpoint is removed once the output is
+//whole, returns false if it couldn't be joined (the segments and checkpoint are kept)
+template <typename Index>
+bool renderCheckpointed(Checkpoint* cp, Pixel<Index>* pixelArray, uint8_t* rgb, RenderContext* ctx) {
+	Index size = (Index)cp->width * cp->height;
+	long long copyBytes = (long long)size * sizeof(Pixel<Index>);
+	trackAlloc(MEM_PIXELS, copyBytes);
+	bool resumed = !cp->pixels.empty();
+	if (resumed) {
+		//back to the start of the action that was running
+		memcpy(pixelArray, cp->pixels.data(), copyBytes);
+		updateRGB(pixelArray, rgb, size);
+		ctx->frameCount = cp->actionStart;
+		ctx->replayUntil = cp->operation;
+		ctx->seed = cp->seed;
+		ctx->skip = cp->skip;
+	}
+	else {
+		if (!ctx->seed) {
+			ctx->seed = (unsigned int)time(0);
+		}
+		cp->seed = ctx->seed;
+		cp->skip = ctx->skip;
+	}
+
+	try {
+		ctx->capture = createSegment(*cp, ctx->logger);
+		ctx->checkpoint = cp;
+		int first = cp->action;
+		for (int i = first; i < (int)cp->actions.size(); i++) {
+			if (i > first || !resumed) {
+				cp->action = i;
+				cp->actionStart = ctx->frameCount;
+				cp->pixels.assign((uint8_t*)pixelArray, (uint8_t*)(pixelArray + size));
+			}
+			runAction(cp->actions[i], pixelArray, rgb, size, cp->sink.fps, ctx);
+		}
+		ctx->checkpoint = NULL;
+		ctx->capture->Finish();
+		delete ctx->capture;
+		ctx->capture = NULL;
+		cp->segments++;
+	}
+	catch (...) {
+		ctx->checkpoint = NULL;
+		trackFree(MEM_PIXELS, copyBytes);
+		throw;
+	}
+	trackFree(MEM_PIXELS, copyBytes);
+
+	if (!joinSegments(*cp, ctx->logger)) {
+		return false;
+	}
+	remove(cp->fileName.c_str());
+	return true;
+}
+
+//sorting_visualizer resume <checkpoint>, finishes a render that stopped after a checkpoint
+int resumeRender(const char* fileName) {
+	Checkpoint cp;
+	std::string error;
+	if (!loadCheckpoint(fileName, &cp, &error)) {
+		std::cout << ">> " << error << "." << std::endl;
+		return 2;
+	}
+	cp.fileName = fileName;
+
+	int width, height;
+	uint8_t* rgb = loadImage(cp.image.c_str(), &width, &height);
+	if (!rgb) {
+		std::cout << ">> Couldn't find " << cp.image << "." << std::endl;
+		return 2;
+	}
+	//shrunk like it was when the render started
+	std::string shrunk;
+	if (shrinkImage(&rgb, &width, &height, cp.maxPixels, &shrunk)) {
+		std::cout << ">> " << cp.image << " " << shrunk << "." << std::endl;
+	}
+	if (width != cp.width || height != cp.height) {
+		std::cout << ">> " << cp.image << " changed since the checkpoint was saved." << std::endl;
+		freeImage(rgb, (long long)width * height);
+		return 2;
+	}
+	std::cout << ">> Resuming at action " << cp.action + 1 << " of " << cp.actions.size() << " (" << cp.actions[cp.action] << "), " << cp.segments << " segments done." << std::endl;
+
+	RenderContext ctx;
+	bool joined;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	try {
+		joined = renderImage(rgb, width, height, cp.actions, cp.sink, &cp, &ctx);
+	}
+	catch (const std::exception& e) {
+		std::cout << std::endl << ">> Stopped: " << e.what() << std::endl;
+		printRunReport(&ctx, width, height, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+		return 1;
+	}
+	std::cout << std::endl;
+	if (!joined) {
+		std::cout << ">> Couldn't join the segments, see Logs.txt." << std::endl;
+	}
+	printRunReport(&ctx, width, height, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+	freeImage(rgb, (long long)width * height);
+	return joined ? 0 : 1;
+}
+
+
+/*----------------------------------------------------------------------BATCH--------------------------------------------------------------------------*/
+
+//one line of a batch job file
+struct Job {
+	std::string image;
+	std::string output;
+	std::vector<std::string> actions;
+	SinkOptions sink; //fileName is the output
+	unsigned int seed;
+	std::string logFile;
+	int logLevel;
+	std::string checkpoint;		//empty for none
+	int checkpointFrames;
+	TileOptions tiles;
+	std::string mapDir;			//empty keeps the pixels in memory
+	long long maxPixels;		//the image is shrunk to at most this many pixels first, 0 for no limit
+	double timeBudget;			//or to what the actions are estimated to do in this many seconds, 0 for no limit
+};
+
+//<image> <output> <action>[,<action>...] [fps=N] [bitrate=N] [sink=video|hash|y4m|yuv420p|rgb24|png|qoi|gif] [seed=N] [stats=file] [fragment=N] [fit=WxH] [colors=bt601|bt709] [range=full|limited] [viewport=WxH] [viewportframes=N] [rendition=WxH:kbps:codec:file]... [checkpoint=file] [checkpointframes=N] [tile=N|rows|cols] [tilesteps=N] [map=dir] [maxpixels=N] [timebudget=S] [log=file] [loglevel=level]
+bool parseJob(const std::string& line, Job* job, std::string* error) {
+	std::stringstream lineStream(line);
+	std::string actionList, option;
+	if (!(lineStream >> job->image >> job->output >> actionList)) {
+		*error = "expected <image> <output> <actions>";
+		return false;
+	}
+	std::stringstream actionStream(actionList);
+	std::string action;
+	while (std::getline(actionStream, action, ',')) {
+		if (!isValidAction(action)) {
+			*error = "invalid action " + action;
+			return false;
+		}
+		job->actions.push_back(action);
+	}
+	job->sink.fileName = job->output;
+	job->seed = 0;
+	job->logFile = (job->output == "-" ? "stdout" : job->output) + ".log";
+	job->logLevel = AV_LOG_INFO;
+	job->checkpointFrames = CHECKPOINT_DEFAULT_FRAMES;
+	job->maxPixels = 0;
+	job->timeBudget = 0;
+	while (lineStream >> option) {
+		size_t equals = option.find('=');
+		std::string key = option.substr(0, equals);
+		std::string value = equals != std::string::npos ? option.substr(equals + 1) : "";
+		if (key == "fps") {
+			job->sink.fps = atoi(value.c_str());
+		}
+		else if (key == "bitrate") {
+			job->sink.bitrate = atoi(value.c_str());
+		}
+		else if (key == "sink" && isValidSink(value)) {
+			job->sink.type = value;
+		}
+		else if (key == "seed") {
+			job->seed = strtoul(value.c_str(), NULL, 10);
+		}
+		else if (key == "stats") {
+			job->sink.statsFile = value;
+		}
+		else if (key == "rendition") {
+			RenditionSpec spec;
+			if (!parseRendition(value, &spec)) {
+				*error = "invalid rendition " + value + ", expected <width>x<height>:<bitrate>:<codec|default>:<file>";
+				return false;
+			}
+			job->sink.renditions.push_back(spec);
+		}
+		else if (key == "colors") {
+			if (!parseMatrix(value, &job->sink.colorMatrix)) {
+				*error = "invalid colors " + value + ", expected bt601 or bt709";
+				return false;
+			}
+		}
+		else if (key == "range" && (value == "full" || value == "limited")) {
+			job->sink.fullRange = value == "full";
+		}
+		else if (key == "fit") {
+			if (!parseSize(value, &job->sink.fitWidth, &job->sink.fitHeight)) {
+				*error = "invalid fit " + value + ", expected <width>x<height>";
+				return false;
+			}
+		}
+		else if (key == "viewport") {
+			if (!parseSize(value, &job->sink.viewWidth, &job->sink.viewHeight)) {
+				*error = "invalid viewport " + value + ", expected <width>x<height>";
+				return false;
+			}
+		}
+		else if (key == "viewportframes" && atoi(value.c_str()) > 0) {
+			job->sink.viewSmoothing = atoi(value.c_str());
+		}
+		else if (key == "fragment") {
+			job->sink.fragmentFrames = std::max(0, atoi(value.c_str()));
+		}
+		else if (key == "checkpoint" && !value.empty()) {
+			job->checkpoint = value;
+		}
+		else if (key == "checkpointframes" && atoi(value.c_str()) > 0) {
+			job->checkpointFrames = atoi(value.c_str());
+		}
+		else if (key == "tile") {
+			if (!parseTiles(value, &job->tiles)) {
+				*error = "invalid tiles " + value + ", expected a size, rows, cols or off";
+				return false;
+			}
+		}
+		else if (key == "tilesteps" && atoi(value.c_str()) > 0) {
+			job->tiles.steps = atoi(value.c_str());
+		}
+		else if (key == "map" && !value.empty()) {
+			job->mapDir = value;
+		}
+		else if (key == "maxpixels" && atoll(value.c_str()) > 0) {
+			job->maxPixels = atoll(value.c_str());
+		}
+		else if (key == "timebudget" && atof(value.c_str()) > 0) {
+			job->timeBudget = atof(value.c_str());
+		}
+		else if (key == "log" && !value.empty()) {
+			job->logFile = value;
+		}
+		else if (key == "loglevel" && logLevelFromName(value) != -1) {
+			job->logLevel = logLevelFromName(value);
+		}
+		else {
+			*error = "invalid option " + option;
+			return false;
+		}
+	}
+	if (job->sink.fps <= 0 || job->sink.bitrate <= 0) {
+		*error = "fps and bitrate need to be positive";
+		return false;
+	}
+	if (job->output == "-" && job->sink.type != "y4m" && job->sink.type != "yuv420p" && job->sink.type != "rgb24") {
+		*error = "only the y4m, yuv420p and rgb24 sinks can write to stdout";
+		return false;
+	}
+	if (!job->checkpoint.empty() && job->tiles.on()) {
+		*error = "tiled jobs can't be checkpointed";
+		return false;
+	}
+	if (!job->mapDir.empty() && job->tiles.on()) {
+		*error = "tiled jobs aren't mapped";
+		return false;
+	}
+	if (!job->checkpoint.empty() && !(*error = checkpointProblem(job->sink)).empty()) {
+		return false;
+	}
+	return true;
+}
+
+//runs a whole job on the calling thread with its own render context and log file,
+//a job with a checkpoint left by an earlier run of the batch carries on from it
+bool runJob(const Job& job, const PlanCostModel& planCost, unsigned long long* operations, std::string* error) {
+	Logger jobLog(job.logFile, job.logLevel);
+	RenderContext ctx;
+	ctx.logger = &jobLog;
+	ctx.seed = job.seed;
+	ctx.quiet = true;
+	ctx.tiles = job.tiles;
+	ctx.mapDir = job.mapDir;
+
+	int width, height;
+	uint8_t* rgb = NULL;
+	try {
+		rgb = loadImage(job.image.c_str(), &width, &height, &jobLog, job.mapDir);
+	}
+	catch (const std::exception& e) {
+		*error = e.what();
+		return false;
+	}
+	if (!rgb) {
+		*error = "couldn't read " + job.image;
+		return false;
+	}
+
+	bool ok = true;
+	try {
+		long long maxPixels = pixelLimit(job.actions, width, height, job.sink, job.seed, job.maxPixels, job.timeBudget, planCost);
+		std::string shrunk;
+		if (shrinkImage(&rgb, &width, &height, maxPixels, &shrunk) && jobLog.Enabled(AV_LOG_INFO)) {
+			jobLog.Log(job.image + " " + shrunk + "\n");
+		}
+		ctx.skip = width + height;
+
+		Checkpoint checkpoint;
+		if (!job.checkpoint.empty() && !startCheckpoint(job.checkpoint, job.checkpointFrames, job.image, job.actions, job.sink, job.seed, maxPixels, width, height, &checkpoint, error)) {
+			ok = false;
+		}
+		else if (!renderImage(rgb, width, height, job.actions, job.sink, job.checkpoint.empty() ? NULL : &checkpoint, &ctx)) {
+			*error = "couldn't join the checkpoint segments";
+			ok = false;
+		}
+	}
+	catch (const std::exception& e) {
+		*error = e.what();
+		ok = false;
+	}
+	*operations = ctx.frameCount;
+	delete ctx.capture;
+	freeImage(rgb, (long long)width * height);
+	return ok;
+}
+
+//runs every job of the file on a pool of worker threads, returns 1 if any failed
+int runBatch(const char* jobFileName, int workers) {
+	std::ifstream jobFile(jobFileName);
+	if (!jobFile) {
+		std::cout << ">> Couldn't find " << jobFileName << "." << std::endl;
+		return 2;
+	}
+
+	std::vector<Job> jobs;
+	std::string line, error;
+	for (int lineNumber = 1; std::getline(jobFile, line); lineNumber++) {
+		if (line.find_first_not_of(" \t\r") == std::string::npos || line[line.find_first_not_of(" \t")] == '#') {
+			continue;
+		}
+		Job job;
+		if (!parseJob(line, &job, &error)) {
+			std::cout << ">> " << jobFileName << ":" << lineNumber << ": " << error << std::endl;
+			return 2;
+		}
+		//outputs (and the temporary files next to them) can't be shared
+		for (size_t i = 0; i < jobs.size(); i++) {
+			if (jobs[i].output == job.output) {
+				std::cout << ">> " << jobFileName << ":" << lineNumber << ": " << job.output << " is already the output of another job" << std::endl;
+				return 2;
+			}
+		}
+		jobs.push_back(job);
+	}
+
+	//a job streaming to stdout gets it to itself, everything printed goes to stderr
+	for (size_t i = 0; i < jobs.size(); i++) {
+		if (jobs[i].output == "-") {
+			videoStdout();
+		}
+	}
+
+	if (workers <= 0) {
+		workers = std::max(1u, std::thread::hardware_concurrency());
+	}
+	workers = std::min(workers, (int)jobs.size());
+	std::cout << ">> Running " << jobs.size() << " jobs on " << workers << " workers." << std::endl;
+
+	//read before the workers start, they only plan with it
+	PlanCostModel planCost = loadPlanCalibration();
+	std::atomic<size_t> nextJob(0);
+	std::atomic<int> failed(0);
+	std::mutex printMutex;
+	std::vector<std::thread> pool;
+	for (int w = 0; w < workers; w++) {
+		pool.push_back(std::thread([&]() {
+			size_t i;
+			while ((i = nextJob++) < jobs.size()) {
+				std::string jobError;
+				unsigned long long operations = 0;
+				std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+				bool ok = runJob(jobs[i], planCost, &operations, &jobError);
+				double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+				std::lock_guard<std::mutex> lock(printMutex);
+				if (ok) {
+					printf(">> [%zu/%zu] %s done, %llu operations in %.1f s\n", i + 1, jobs.size(), jobs[i].output.c_str(), operations, seconds);
+				}
+				else {
+					printf(">> [%zu/%zu] %s failed: %s\n", i + 1, jobs.size(), jobs[i].output.c_str(), jobError.c_str());
+					failed++;
+				}
+			}
+		}));
+	}
+	for (size_t w = 0; w < pool.size(); w++) {
+		pool[w].join();
+	}
+
+	printMemoryReport();
+	return failed > 0 ? 1 : 0;
+}
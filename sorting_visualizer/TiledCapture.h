@@ -0,0 +1,320 @@
+#pragma once
+
+#include <stdint.h>
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "VideoCapture.h"
+
+//splits the image into tileWidth x tileHeight tiles (squares, or whole rows or columns)
+//that are sorted side by side, and composes the frames of the whole image out of
+//them. every tile has its own rgb buffer and capture (TileSink), and a tile handing a
+//frame to it waits there until every other tile got to its next frame (or finished),
+//then the tiles are copied into the image and it goes to the output as one frame. so
+//the video comes out the same however the threads get scheduled. the sorts are
+//recursive and stop in the middle of one at every frame, so each tile runs on its own
+//thread, but only workers of them sort at a time, the rest wait in line for a slot
+#define TILED_MAX_TILES 4096
+
+class TiledCapture {
+public:
+
+	//thrown out of the sorts of the other tiles when one failed, or the output did
+	struct Stopped {};
+
+	//image is width x height rgb, the tiles start as their part of it and it gets
+	//composed back into, output receives the composed frames
+	TiledCapture(CaptureSink* outputCapture, uint8_t* imageRGB, int width, int height, int tileWidth, int tileHeight, int workerCount) {
+		output = outputCapture;
+		image = imageRGB;
+		imageWidth = width;
+		workers = std::max(1, workerCount);
+		running = 0;
+		parked = 0;
+		active = 0;
+		stopping = false;
+		tileBytes = (long long)width * height * 3;
+		trackAlloc(MEM_FRAMES, tileBytes);
+		for (int y = 0; y < height; y += tileHeight) {
+			for (int x = 0; x < width; x += tileWidth) {
+				Tile* tile = new Tile();
+				tile->x = x;
+				tile->y = y;
+				tile->width = std::min(tileWidth, width - x);
+				tile->height = std::min(tileHeight, height - y);
+				tile->rgb = new uint8_t[(size_t)tile->width * tile->height * 3];
+				for (int row = 0; row < tile->height; row++) {
+					memcpy(tile->rgb + (size_t)row * tile->width * 3, imageRow(tile, row), (size_t)tile->width * 3);
+				}
+				tile->sink = new TileSink(this, (int)tiles.size());
+				tile->operation = 0;
+				tile->changed = 0;
+				tile->dirty = false;
+				tile->parked = false;
+				tile->go = false;
+				tiles.push_back(tile);
+			}
+		}
+	}
+
+	~TiledCapture() {
+		for (size_t i = 0; i < tiles.size(); i++) {
+			delete tiles[i]->sink;
+			delete[] tiles[i]->rgb;
+			delete tiles[i];
+		}
+		trackFree(MEM_FRAMES, tileBytes);
+	}
+
+	int Tiles() const {
+		return (int)tiles.size();
+	}
+
+	int TileWidth(int tile) const {
+		return tiles[tile]->width;
+	}
+
+	int TileHeight(int tile) const {
+		return tiles[tile]->height;
+	}
+
+	//the tile's rgb, sorted in place like the whole image would be
+	uint8_t* TileRGB(int tile) {
+		return tiles[tile]->rgb;
+	}
+
+	//what the tile's sorts add their frames to
+	CaptureSink* Capture(int tile) {
+		return tiles[tile]->sink;
+	}
+
+	//runs work(tile) for every tile on its own thread and hands the composed frames to
+	//the output on the calling thread until all are done, progress(frames, tiles still
+	//sorting) after each one. rethrows what stopped a tile or the output, after every
+	//tile stopped. the image holds the sorted tiles afterwards
+	void Run(const std::function<void(int)>& work, const std::function<void(unsigned long long, int)>& progress) {
+		active = (int)tiles.size();
+		std::vector<std::thread> threads;
+		for (size_t i = 0; i < tiles.size(); i++) {
+			threads.push_back(std::thread(&TiledCapture::runTile, this, (int)i, std::cref(work)));
+		}
+
+		unsigned long long frames = 0;
+		try {
+			while (true) {
+				std::unique_lock<std::mutex> lock(mutex);
+				composeReady.wait(lock, [this]() { return stopping || parked == active; });
+				if (stopping || active == 0) {
+					break;
+				}
+				//every tile still sorting waits for the next round, so the buffers hold still
+				lock.unlock();
+
+				FrameInfo frameInfo;
+				frameInfo.operation = 0;
+				frameInfo.changed = 0;
+				//the tiles' ranges don't make one range of the image
+				frameInfo.touchedFirst = -1;
+				frameInfo.touchedLast = -1;
+				for (size_t i = 0; i < tiles.size(); i++) {
+					frameInfo.operation += tiles[i]->operation;
+					frameInfo.changed += tiles[i]->changed;
+					tiles[i]->changed = 0;
+				}
+				compose();
+				output->SetFrameInfo(frameInfo);
+				output->AddFrame(image);
+				progress(++frames, active);
+
+				//next round, in tile order so the first ones get the free slots
+				lock.lock();
+				parked = 0;
+				for (size_t i = 0; i < tiles.size(); i++) {
+					if (tiles[i]->parked) {
+						tiles[i]->parked = false;
+						schedule((int)i);
+					}
+				}
+			}
+		}
+		catch (...) {
+			stop(std::current_exception());
+		}
+		for (size_t i = 0; i < threads.size(); i++) {
+			threads[i].join();
+		}
+		compose();
+		if (error) {
+			std::rethrow_exception(error);
+		}
+	}
+
+private:
+
+	//a tile's frames go to the round instead of an encoder
+	class TileSink : public CaptureSink {
+	public:
+		TileSink(TiledCapture* tiledCapture, int tileIndex) {
+			owner = tiledCapture;
+			index = tileIndex;
+		}
+
+		void Init(int width, int height, int fpsrate, int bitrate) {}
+
+		void AddFrame(uint8_t *data) {
+			owner->park(index, info);
+		}
+
+		void Finish() {}
+
+	private:
+		TiledCapture* owner;
+		int index;
+	};
+
+	struct Tile {
+		int x;
+		int y;
+		int width;
+		int height;
+		uint8_t* rgb;
+		TileSink* sink;
+		unsigned long long operation;	//operations done at its last frame
+		unsigned int changed;			//pixels changed since the last composed frame
+		bool dirty;						//changed since it was last copied into the image
+		bool parked;					//waiting for the next round
+		bool go;						//was given a slot
+		std::condition_variable wake;	//for go, so a free slot wakes only the tile it goes to
+	};
+
+	CaptureSink* output;
+	uint8_t* image;
+	int imageWidth;
+	long long tileBytes;
+	std::vector<Tile*> tiles;
+
+	//the round, all under mutex
+	int workers;
+	int running;		//tiles sorting right now
+	int parked;			//tiles waiting for the next round
+	int active;			//tiles not done yet
+	std::deque<int> ready;	//tiles waiting for a slot, in line
+	bool stopping;
+	std::exception_ptr error;
+	std::mutex mutex;
+	std::condition_variable composeReady;	//every active tile is parked
+
+	uint8_t* imageRow(Tile* tile, int row) {
+		return image + ((size_t)(tile->y + row) * imageWidth + tile->x) * 3;
+	}
+
+	//copies the tiles that changed into the image
+	void compose() {
+		for (size_t i = 0; i < tiles.size(); i++) {
+			Tile* tile = tiles[i];
+			if (!tile->dirty) {
+				continue;
+			}
+			for (int row = 0; row < tile->height; row++) {
+				memcpy(imageRow(tile, row), tile->rgb + (size_t)row * tile->width * 3, (size_t)tile->width * 3);
+			}
+			tile->dirty = false;
+		}
+	}
+
+	//gives the tile a slot if one is free, or puts it in line, with mutex held
+	void schedule(int index) {
+		if (running < workers) {
+			running++;
+			tiles[index]->go = true;
+			tiles[index]->wake.notify_one();
+		}
+		else {
+			ready.push_back(index);
+		}
+	}
+
+	//hands the caller's slot to the next tile in line, with mutex held
+	void release() {
+		running--;
+		if (!ready.empty()) {
+			int next = ready.front();
+			ready.pop_front();
+			schedule(next);
+		}
+	}
+
+	//waits until the tile was given a slot, with mutex held
+	void waitForSlot(std::unique_lock<std::mutex>& lock, int index) {
+		Tile* tile = tiles[index];
+		tile->wake.wait(lock, [this, tile]() { return stopping || tile->go; });
+		if (stopping) {
+			throw Stopped();
+		}
+		tile->go = false;
+	}
+
+	//called from the tile's sorts at every frame, returns when the frame is composed
+	//and the tile got a slot again
+	void park(int index, const FrameInfo& frameInfo) {
+		std::unique_lock<std::mutex> lock(mutex);
+		tiles[index]->operation = frameInfo.operation;
+		tiles[index]->changed += frameInfo.changed;
+		tiles[index]->dirty = true;
+		tiles[index]->parked = true;
+		parked++;
+		release();
+		if (parked == active) {
+			composeReady.notify_one();
+		}
+		waitForSlot(lock, index);
+	}
+
+	void runTile(int index, const std::function<void(int)>& work) {
+		try {
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				schedule(index);
+				waitForSlot(lock, index);
+			}
+			work(index);
+		}
+		catch (const Stopped&) {
+		}
+		catch (...) {
+			stop(std::current_exception());
+		}
+		std::lock_guard<std::mutex> lock(mutex);
+		//once stopped the slots don't matter anymore
+		if (!stopping) {
+			tiles[index]->dirty = true;
+			release();
+		}
+		active--;
+		if (parked == active) {
+			composeReady.notify_one();
+		}
+	}
+
+	//keeps the first failure and wakes everything up to unwind
+	void stop(std::exception_ptr failure) {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (!error) {
+				error = failure;
+			}
+			stopping = true;
+			for (size_t i = 0; i < tiles.size(); i++) {
+				tiles[i]->wake.notify_all();
+			}
+		}
+		composeReady.notify_all();
+	}
+};
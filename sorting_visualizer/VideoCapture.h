@@ -10,6 +10,12 @@
 #include <string.h>
 #include <algorithm>
 #include <string> 
+#include <mutex>
+#include <vector>
+
+#include "Logger.h"
+#include "MemoryStats.h"
+#include "YuvConverter.h"
 
 extern "C"
 {
@@ -49,35 +55,199 @@ extern "C"
 
 #include <libswscale/swscale.h>
 
-	std::ofstream logFile;
-
-	void Log(std::string str) {
-		logFile.open("Logs.txt", std::ofstream::app);
-		logFile.write(str.c_str(), str.size());
-		logFile.close();
+	//libav calls this from whatever thread is encoding, the line goes to the logger
+	//of the capture it came from (codec and format contexts carry it in opaque)
+	void avlog_cb(void *avcl, int level, const char * fmt, va_list vargs) {
+		Logger* logger = &defaultLogger();
+		AVClass* avc = avcl ? *(AVClass**)avcl : NULL;
+		if (avc && avc->class_name) {
+			if (!strcmp(avc->class_name, "AVCodecContext") && ((AVCodecContext*)avcl)->opaque) {
+				logger = (Logger*)((AVCodecContext*)avcl)->opaque;
+			}
+			else if (!strcmp(avc->class_name, "AVFormatContext") && ((AVFormatContext*)avcl)->opaque) {
+				logger = (Logger*)((AVFormatContext*)avcl)->opaque;
+			}
+		}
+		if (!logger->Enabled(level)) {
+			return;
+		}
+		thread_local char message[8192];
+		vsnprintf_s(message, sizeof(message), fmt, vargs);
+		logger->Log(message);
 	}
 
-	typedef void(*FuncPtr)(const char *);
-	FuncPtr ExtDebug;
-	char errbuf[32];
+	//what the sort did between the previous frame and the one about to be added
+	struct FrameInfo {
+		unsigned long long operation;	//operations done so far (FRAMECOUNT)
+		unsigned int changed;	//pixels whose color changed since the previous frame
+		long long touchedFirst;	//lowest and highest pixel index written since the previous frame, -1 for none
+		long long touchedLast;
+	};
+
+	//anything the sorts can hand frames to (the encoder, or a stand in for it)
+	class CaptureSink {
+	public:
+		CaptureSink() {
+			info.operation = 0;
+			info.changed = 0;
+			info.touchedFirst = -1;
+			info.touchedLast = -1;
+			logger = &defaultLogger();
+		}
+
+		virtual ~CaptureSink() {}
+
+		//called before every AddFrame
+		void SetFrameInfo(FrameInfo frameInfo) {
+			info = frameInfo;
+		}
 
-	void Debug(std::string str, int err) {
-		Log(str + " " + std::to_string(err));
-		if (err < 0) {
-			av_strerror(err, errbuf, sizeof(errbuf));
-			str += errbuf;
+		//where errors go, before Init
+		void SetLogger(Logger* newLogger) {
+			logger = newLogger;
 		}
-		Log(str);
-		ExtDebug(str.c_str());
+
+		virtual void Init(int width, int height, int fpsrate, int bitrate) = 0;
+
+		virtual void AddFrame(uint8_t *data) = 0;
+
+		virtual void Finish() = 0;
+
+	protected:
+
+		FrameInfo info;
+		Logger* logger;
+	};
+
+	//drops every frame, used to time the sorts without the encoder
+	class NullCapture : public CaptureSink {
+	public:
+		void Init(int width, int height, int fpsrate, int bitrate) {}
+
+		void AddFrame(uint8_t *data) {}
+
+		void Finish() {}
+	};
+
+	//receives the finished container a chunk at a time, returns < 0 to stop
+	typedef int(*VideoWriteFunc)(void *opaque, const uint8_t *data, int size);
+
+	//a file in memory for libav to read, write and seek through a custom AVIOContext,
+	//or (with a write function) a stream that hands every write on without keeping it
+	struct MemoryIO {
+		std::vector<uint8_t> bytes;
+		size_t pos;
+		long long tracked; //capacity reported to the memory stats
+		VideoWriteFunc writeFn;
+		void *writeOpaque;
+
+		MemoryIO() {
+			pos = 0;
+			tracked = 0;
+			writeFn = NULL;
+			writeOpaque = NULL;
+		}
+
+		~MemoryIO() {
+			Clear();
+		}
+
+		void Clear() {
+			std::vector<uint8_t>().swap(bytes);
+			pos = 0;
+			trackFree(MEM_OUTPUT, tracked);
+			tracked = 0;
+		}
+
+		static int Read(void *opaque, uint8_t *buf, int size) {
+			MemoryIO *io = (MemoryIO*)opaque;
+			size_t left = io->bytes.size() - std::min(io->pos, io->bytes.size());
+			if (!left) {
+				return AVERROR_EOF;
+			}
+			size = (int)std::min((size_t)size, left);
+			memcpy(buf, &io->bytes[io->pos], size);
+			io->pos += size;
+			return size;
+		}
+
+		static int Write(void *opaque, uint8_t *buf, int size) {
+			MemoryIO *io = (MemoryIO*)opaque;
+			if (io->writeFn) {
+				return io->writeFn(io->writeOpaque, buf, size) < 0 ? AVERROR_EXTERNAL : size;
+			}
+			if (io->pos + size > io->bytes.size()) {
+				size_t capacity = io->bytes.capacity();
+				try {
+					io->bytes.resize(io->pos + size);
+					if (io->bytes.capacity() != capacity) {
+						trackAlloc(MEM_OUTPUT, (long long)io->bytes.capacity() - io->tracked);
+						io->tracked = (long long)io->bytes.capacity();
+					}
+				}
+				catch (const std::exception&) {
+					//over the memory budget, or out of memory, can't throw through libav
+					return AVERROR(ENOMEM);
+				}
+			}
+			memcpy(&io->bytes[io->pos], buf, size);
+			io->pos += size;
+			return size;
+		}
+
+		static int64_t Seek(void *opaque, int64_t offset, int whence) {
+			MemoryIO *io = (MemoryIO*)opaque;
+			if (whence & AVSEEK_SIZE) {
+				return (int64_t)io->bytes.size();
+			}
+			switch (whence & ~AVSEEK_FORCE) {
+			case SEEK_SET: break;
+			case SEEK_CUR: offset += io->pos; break;
+			case SEEK_END: offset += io->bytes.size(); break;
+			default: return AVERROR(EINVAL);
+			}
+			if (offset < 0) {
+				return AVERROR(EINVAL);
+			}
+			io->pos = (size_t)offset;
+			return offset;
+		}
+	};
+
+	//an AVIOContext over io (reading from the start if not write), NULL if it can't be allocated
+	inline AVIOContext* openMemoryIO(MemoryIO *io, bool write) {
+		const int bufferSize = 1 << 16;
+		uint8_t *buffer = (uint8_t*)av_malloc(bufferSize);
+		if (!buffer) {
+			return NULL;
+		}
+		io->pos = 0;
+		bool stream = write && io->writeFn;
+		AVIOContext *pb = avio_alloc_context(buffer, bufferSize, write ? 1 : 0, io,
+			write ? NULL : &MemoryIO::Read, write ? &MemoryIO::Write : NULL, stream ? NULL : &MemoryIO::Seek);
+		if (!pb) {
+			av_free(buffer);
+			return NULL;
+		}
+		if (stream) {
+			pb->seekable = 0;
+		}
+		return pb;
 	}
 
-	void avlog_cb(void *, int level, const char * fmt, va_list vargs) {
-		static char message[8192];
-		vsnprintf_s(message, sizeof(message), fmt, vargs);
-		Log(message);
+	//flushes (when writing) and frees what openMemoryIO made, never call avio_close on it
+	inline void closeMemoryIO(AVIOContext **pb) {
+		if (!*pb) {
+			return;
+		}
+		if ((*pb)->write_flag) {
+			avio_flush(*pb);
+		}
+		av_freep(&(*pb)->buffer);
+		avio_context_free(pb);
 	}
 
-	class VideoCapture {
+	class VideoCapture : public CaptureSink {
 	public:
 
 		VideoCapture() {
@@ -85,8 +255,28 @@ extern "C"
 			ofctx = NULL;
 			videoStream = NULL;
 			videoFrame = NULL;
+			codec = NULL;
+			cctx = NULL;
 			swsCtx = NULL;
 			frameCounter = 0;
+			frameBytes = 0;
+			encoderBytes = 0;
+			statsFile = NULL;
+			memoryOutput = false;
+			fragmentFrames = 0;
+			srcWidth = 0;
+			srcHeight = 0;
+			outWidth = 0;
+			outHeight = 0;
+			fitWidth = 0;
+			fitHeight = 0;
+			areaX = 1;
+			areaY = 1;
+			areaFrame = NULL;
+			colorMatrix = YUV_BT601;
+			fullRange = false;
+			tmpFileName = "tmp.h264";
+			finalFileName = "sortingSample.mp4";
 
 			// Initialize libavcodec
 			//av_register_all(); outdated
@@ -95,6 +285,9 @@ extern "C"
 
 		~VideoCapture() {
 			Free();
+			if (statsFile) {
+				fclose(statsFile);
+			}
 		}
 
 		void Init(int width, int height, int fpsrate, int bitrate);
@@ -103,6 +296,83 @@ extern "C"
 
 		void Finish();
 
+		//where the raw stream and the remuxed video are written (before Init), an empty
+		//finalFile keeps just the raw stream (checkpoint segments, see RemuxStream)
+		void SetOutput(std::string tmpFile, std::string finalFile) {
+			tmpFileName = tmpFile;
+			finalFileName = finalFile;
+		}
+
+		//remuxes a raw stream written earlier (e.g. checkpoint segments joined back
+		//together) from the tmp file into the final one, without encoding anything
+		void RemuxStream(int fpsrate) {
+			fps = fpsrate;
+			Remux();
+		}
+
+		//encode at another size (scaled in AddFrame, rounded down to even) and/or with
+		//an encoder by name (e.g. libx264, libvpx-vp9) instead of the format's default,
+		//before Init. 0 keeps the frame size, an empty codec the default. any codec but
+		//h264 needs a tmp file in a container that holds it (e.g. .mkv, see SetOutput)
+		void SetRendition(int width, int height, std::string codec) {
+			outWidth = width & ~1;
+			outHeight = height & ~1;
+			codecName = codec;
+		}
+
+		//encode frames bigger than width x height scaled down to fit inside it, keeping
+		//their aspect ratio, before Init. 0 (or a rendition size) leaves them alone. when
+		//the frame is a whole multiple of the fitted size each output pixel is the average
+		//of its block, and only the small frame goes through the scaler
+		void SetOutputSize(int width, int height) {
+			fitWidth = width;
+			fitHeight = height;
+		}
+
+		//the matrix and range the rgb frames are converted to yuv with (and the video is
+		//tagged with, so players convert back the same way), before Init. BT.601
+		//limited range unless set, like swscale's default
+		void SetColors(YuvMatrix matrix, bool full) {
+			colorMatrix = matrix;
+			fullRange = full;
+		}
+
+		//mux straight into the final file as a fragmented mp4 (or mkv, from the file
+		//name) and flush a fragment every frames frames, instead of writing tmp.h264
+		//and remuxing it in Finish. the file plays while it's written, and up to the
+		//last flush if the render dies (before Init)
+		void SetFragmented(int frames) {
+			fragmentFrames = frames;
+		}
+
+		//keep everything in memory instead of writing tmp.h264 and the mp4 (before Init),
+		//the finished mp4 is in Output() after Finish
+		void SetMemoryOutput() {
+			memoryOutput = true;
+		}
+
+		//like SetMemoryOutput, but the mp4 is handed to fn a chunk at a time as it's
+		//muxed (fragmented, since a stream can't be seeked back into) and not kept
+		void SetWriteCallback(VideoWriteFunc fn, void *opaque) {
+			memoryOutput = true;
+			finalIO.writeFn = fn;
+			finalIO.writeOpaque = opaque;
+		}
+
+		//the finished container in memory mode, empty otherwise or if it failed
+		const std::vector<uint8_t>& Output() const {
+			return finalIO.bytes;
+		}
+
+		//write a csv row for every frame (timings and packet sizes), before Init
+		bool EnableStats(std::string fileName) {
+			if (!(statsFile = fopen(fileName.c_str(), "w"))) {
+				return false;
+			}
+			fprintf(statsFile, "frame,operation,pixels_changed,convert_ms,encode_ms,packet_pts,packet_bytes\n");
+			return true;
+		}
+
 	private:
 
 		AVOutputFormat *oformat;
@@ -120,9 +390,51 @@ extern "C"
 
 		int fps;
 
+		//what this capture has reported to the memory stats
+		long long frameBytes;
+		long long encoderBytes;
+
+		std::string tmpFileName;
+		std::string finalFileName;
+
+		FILE *statsFile;
+
+		int fragmentFrames; //0 when writing tmp.h264 and remuxing
+
+		//size of the frames given to AddFrame, and of the video (0 for the same)
+		int srcWidth;
+		int srcHeight;
+		int outWidth;
+		int outHeight;
+		std::string codecName;
+
+		//SetOutputSize's box, and the block averaged into each pixel (1 x 1 for none)
+		int fitWidth;
+		int fitHeight;
+		int areaX;
+		int areaY;
+		uint8_t *areaFrame;			//the averaged rgb frame, at the video's size
+		std::vector<uint32_t> areaSums;	//one row of block sums
+
+		//frames at the video's size are converted by converter, only scaled ones by swscale
+		YuvConverter converter;
+		YuvMatrix colorMatrix;
+		bool fullRange;
+
+		//memory mode: the encoded stream and the finished container
+		bool memoryOutput;
+		MemoryIO tmpIO;
+		MemoryIO finalIO;
+
 		void Free();
 
+		void closeRemux(AVFormatContext **ifmt_ctx, AVFormatContext **ofmt_ctx);
+
 		void Remux();
+
+		void writePacket(AVPacket *pkt);
+
+		void averageArea(const uint8_t *data);
 	};
 
 	VIDEOCAPTURE_API VideoCapture* Init(int width, int height, int fps, int bitrate) {
@@ -131,6 +443,28 @@ extern "C"
 		return vc;
 	};
 
+	//same as Init, but nothing touches the disk, read the mp4 with GetOutput after Finish
+	VIDEOCAPTURE_API VideoCapture* InitMemory(int width, int height, int fps, int bitrate) {
+		VideoCapture *vc = new VideoCapture();
+		vc->SetMemoryOutput();
+		vc->Init(width, height, fps, bitrate);
+		return vc;
+	};
+
+	//same as Init, but the (fragmented) mp4 goes to fn as it's made during Finish
+	VIDEOCAPTURE_API VideoCapture* InitStream(int width, int height, int fps, int bitrate, VideoWriteFunc fn, void *opaque) {
+		VideoCapture *vc = new VideoCapture();
+		vc->SetWriteCallback(fn, opaque);
+		vc->Init(width, height, fps, bitrate);
+		return vc;
+	};
+
+	//size of the mp4 made by an InitMemory capture, data points into the capture
+	VIDEOCAPTURE_API int GetOutput(VideoCapture *vc, const uint8_t **data) {
+		*data = vc->Output().empty() ? NULL : vc->Output().data();
+		return (int)vc->Output().size();
+	}
+
 	VIDEOCAPTURE_API void AddFrame(uint8_t *data, VideoCapture *vc) {
 		vc->AddFrame(data);
 	}
@@ -140,6 +474,6 @@ extern "C"
 	}
 
 	VIDEOCAPTURE_API void SetDebug(FuncPtr fp) {
-		ExtDebug = fp;
+		defaultLogger().SetDebug(fp);
 	};
 }
\ No newline at end of file
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <stdint.h>
+#include <algorithm>
+#include <cstring>
+
+#include "VideoCapture.h"
+
+//hands the output a viewWidth x viewHeight window of every frame instead of the
+//whole image, so a big image is encoded at the size of the part that's moving. the
+//window follows the pixels the sort wrote since the previous frame (the range in
+//FrameInfo): its center moves 1/smoothing of the way there every frame, so it
+//glides after the sort instead of jumping with every partition, and stays put on
+//frames where nothing was written. a range over more than one row is centered
+//across the width, the rows are what the sorts work through
+#define VIEWPORT_DEFAULT_SMOOTHING 30	//frames the window takes to (mostly) catch up
+
+class ViewportCapture : public CaptureSink {
+public:
+
+	//takes ownership of output, smoothing 1 moves the window right onto the range
+	ViewportCapture(CaptureSink* outputCapture, int width, int height, int smoothingFrames) {
+		output = outputCapture;
+		viewWidth = width;
+		viewHeight = height;
+		smoothing = std::max(1, smoothingFrames);
+		imageWidth = 0;
+		imageHeight = 0;
+		centerX = 0;
+		centerY = 0;
+		placed = false;
+		view = NULL;
+		viewBytes = 0;
+	}
+
+	~ViewportCapture() {
+		delete output;
+		if (view) {
+			delete[] view;
+			trackFree(MEM_FRAMES, viewBytes);
+		}
+	}
+
+	void Init(int width, int height, int fpsrate, int bitrate) {
+		imageWidth = width;
+		imageHeight = height;
+		viewWidth = std::min(viewWidth, width);
+		viewHeight = std::min(viewHeight, height);
+		//in the middle until the sort writes somewhere
+		centerX = width / 2.0;
+		centerY = height / 2.0;
+		viewBytes = (long long)viewWidth * viewHeight * 3;
+		trackAlloc(MEM_FRAMES, viewBytes);
+		view = new uint8_t[(size_t)viewBytes];
+		output->SetLogger(logger);
+		output->Init(viewWidth, viewHeight, fpsrate, bitrate);
+	}
+
+	void AddFrame(uint8_t *data) {
+		if (info.touchedFirst >= 0) {
+			long long firstRow = info.touchedFirst / imageWidth;
+			long long lastRow = info.touchedLast / imageWidth;
+			double targetX = firstRow == lastRow ? (info.touchedFirst % imageWidth + info.touchedLast % imageWidth + 1) / 2.0 : imageWidth / 2.0;
+			double targetY = (firstRow + lastRow + 1) / 2.0;
+			//the first range the window goes straight to
+			double step = placed ? 1.0 / smoothing : 1.0;
+			centerX += (targetX - centerX) * step;
+			centerY += (targetY - centerY) * step;
+			placed = true;
+		}
+		int left = std::max(0, std::min(imageWidth - viewWidth, (int)(centerX - viewWidth / 2.0 + 0.5)));
+		int top = std::max(0, std::min(imageHeight - viewHeight, (int)(centerY - viewHeight / 2.0 + 0.5)));
+		for (int row = 0; row < viewHeight; row++) {
+			memcpy(view + (size_t)row * viewWidth * 3, data + ((size_t)(top + row) * imageWidth + left) * 3, (size_t)viewWidth * 3);
+		}
+		output->SetFrameInfo(info);
+		output->AddFrame(view);
+	}
+
+	void Finish() {
+		output->Finish();
+	}
+
+private:
+	CaptureSink* output;
+	int viewWidth;
+	int viewHeight;
+	int smoothing;
+	int imageWidth;
+	int imageHeight;
+	double centerX;		//the middle of the window, in pixels of the image
+	double centerY;
+	bool placed;		//the window went to a range already
+	uint8_t* view;
+	long long viewBytes;
+};
@@ -0,0 +1,359 @@
+#pragma once
+
+#include <stdint.h>
+#include <algorithm>
+#include <cmath>
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "CpuFeatures.h"
+
+//rgb24 to planar 4:2:0 at the same size, for the encoder when nothing is scaled,
+//instead of swscale's general path. the matrix and range are the ones the video is
+//tagged with, chroma is the average of each 2x2 block (an odd last column or row
+//is counted twice). the coefficients are 15 bit fixed point, the SSSE3 and AVX2
+//loops give exactly what the scalar one does. big frames are split into bands
+//of rows converted on a pool of threads that's kept between frames
+#define YUV_THREAD_PIXELS (1 << 19)		//frames smaller than this are converted on the calling thread
+#define YUV_BAND_ROWS 64				//at least this many rows per thread
+
+enum YuvMatrix {
+	YUV_BT601,		//what swscale (and most players, for SD) assume
+	YUV_BT709		//HD
+};
+
+class YuvConverter {
+public:
+
+	YuvConverter() {
+		level = simdLevel();
+		stopping = false;
+		generation = 0;
+		pending = 0;
+		activeBands = 0;
+		SetColors(YUV_BT601, false);
+	}
+
+	~YuvConverter() {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		wake.notify_all();
+		for (size_t i = 0; i < workers.size(); i++) {
+			workers[i].join();
+		}
+	}
+
+	//full range uses all of 0..255, limited (what video usually is) 16..235 and 16..240
+	void SetColors(YuvMatrix matrix, bool fullRange) {
+		double kr = matrix == YUV_BT709 ? 0.2126 : 0.299;
+		double kb = matrix == YUV_BT709 ? 0.0722 : 0.114;
+		double yScale = fullRange ? 1.0 : 219.0 / 255;
+		double cScale = fullRange ? 1.0 : 224.0 / 255;
+		//green takes the rounding, so white is exactly the top of the range and gray has no color
+		int yTotal = (int)lround(yScale * 32768);
+		yCoef[0] = (int16_t)lround(kr * yScale * 32768);
+		yCoef[2] = (int16_t)lround(kb * yScale * 32768);
+		yCoef[1] = (int16_t)(yTotal - yCoef[0] - yCoef[2]);
+		double u = cScale / (2 * (1 - kb)) * 32768;
+		uCoef[0] = (int16_t)lround(-kr * u);
+		uCoef[2] = (int16_t)lround((1 - kb) * u);
+		uCoef[1] = (int16_t)(-uCoef[0] - uCoef[2]);
+		double v = cScale / (2 * (1 - kr)) * 32768;
+		vCoef[0] = (int16_t)lround((1 - kr) * v);
+		vCoef[2] = (int16_t)lround(-kb * v);
+		vCoef[1] = (int16_t)(-vCoef[0] - vCoef[2]);
+		//offsets with half a step for rounding, chroma works on sums of 4 pixels (2 more bits)
+		yOffset = ((fullRange ? 0 : 16) << 15) + (1 << 14);
+		cOffset = (128 << 17) + (1 << 16);
+	}
+
+	//which loop to use, the best the cpu has unless bench asks for another
+	void SetLevel(SimdLevel simd) {
+		level = std::min(simd, simdLevel());
+	}
+
+	//rgb (width x height, rows packed) into the planes of a yuv420p frame
+	void Convert(const uint8_t* rgb, int width, int height, uint8_t* const planes[3], const int linesizes[3]) {
+		frame.rgb = rgb;
+		frame.width = width;
+		frame.height = height;
+		for (int i = 0; i < 3; i++) {
+			frame.planes[i] = planes[i];
+			frame.linesizes[i] = linesizes[i];
+		}
+		int pairs = (height + 1) / 2;
+		int bands = 1;
+		if ((long long)width * height >= YUV_THREAD_PIXELS) {
+			bands = std::max(1, std::min((int)std::thread::hardware_concurrency(), pairs / (YUV_BAND_ROWS / 2)));
+		}
+		if (bands == 1) {
+			convertPairs(0, pairs);
+			return;
+		}
+		startWorkers(bands - 1);
+		bandPairs = (pairs + bands - 1) / bands;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			activeBands = (pairs + bandPairs - 1) / bandPairs;
+			pending = activeBands - 1;
+			generation++;
+		}
+		wake.notify_all();
+		//the first band on this thread
+		convertPairs(0, std::min(bandPairs, pairs));
+		std::unique_lock<std::mutex> lock(mutex);
+		done.wait(lock, [this]() { return pending == 0; });
+	}
+
+private:
+
+	struct Frame {
+		const uint8_t* rgb;
+		int width;
+		int height;
+		uint8_t* planes[3];
+		int linesizes[3];
+	};
+
+	SimdLevel level;
+	int16_t yCoef[3];
+	int16_t uCoef[3];
+	int16_t vCoef[3];
+	int yOffset;
+	int cOffset;
+
+	//the frame being converted and the pool, bands are handed out by index
+	Frame frame;
+	int bandPairs;
+	std::vector<std::thread> workers;
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::condition_variable done;
+	unsigned long long generation;	//bumped for every frame the workers convert
+	int activeBands;				//bands of that frame, the first is the calling thread's
+	int pending;					//worker bands still converting
+	bool stopping;
+
+	void startWorkers(int count) {
+		while ((int)workers.size() < count) {
+			workers.push_back(std::thread(&YuvConverter::work, this, (int)workers.size() + 1));
+		}
+	}
+
+	//worker band takes the band'th slice of every frame that has one
+	void work(int band) {
+		unsigned long long seen = 0;
+		while (true) {
+			bool mine;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				wake.wait(lock, [this, seen]() { return stopping || generation != seen; });
+				if (stopping) {
+					return;
+				}
+				seen = generation;
+				mine = band < activeBands;
+			}
+			if (!mine) {
+				continue;
+			}
+			int pairs = (frame.height + 1) / 2;
+			convertPairs(band * bandPairs, std::min(pairs, (band + 1) * bandPairs));
+			std::lock_guard<std::mutex> lock(mutex);
+			if (--pending == 0) {
+				done.notify_one();
+			}
+		}
+	}
+
+	//row pairs first .. last (a pair is two luma rows and one chroma row)
+	void convertPairs(int first, int last) {
+		for (int pair = first; pair < last; pair++) {
+			int y = pair * 2;
+			const uint8_t* row0 = frame.rgb + (size_t)y * frame.width * 3;
+			bool second = y + 1 < frame.height;
+			const uint8_t* row1 = second ? row0 + (size_t)frame.width * 3 : row0;
+			uint8_t* yRow0 = frame.planes[0] + (size_t)y * frame.linesizes[0];
+			uint8_t* yRow1 = second ? yRow0 + frame.linesizes[0] : NULL;
+			uint8_t* uRow = frame.planes[1] + (size_t)pair * frame.linesizes[1];
+			uint8_t* vRow = frame.planes[2] + (size_t)pair * frame.linesizes[2];
+			int x = 0;
+#ifdef SIMD_X86
+			if (level >= SIMD_AVX2) {
+				x = pairAVX2(row0, row1, yRow0, yRow1, uRow, vRow, frame.width);
+			}
+			else if (level >= SIMD_SSSE3) {
+				x = pairSSSE3(row0, row1, yRow0, yRow1, uRow, vRow, frame.width);
+			}
+#endif
+			pairScalar(row0, row1, yRow0, yRow1, uRow, vRow, x, frame.width);
+		}
+	}
+
+	uint8_t luma(const uint8_t* pixel) const {
+		int value = (yCoef[0] * pixel[0] + yCoef[1] * pixel[1] + yCoef[2] * pixel[2] + yOffset) >> 15;
+		return (uint8_t)std::max(0, std::min(255, value));
+	}
+
+	static uint8_t chroma(const int16_t* coef, int r, int g, int b, int offset) {
+		int value = (coef[0] * r + coef[1] * g + coef[2] * b + offset) >> 17;
+		return (uint8_t)std::max(0, std::min(255, value));
+	}
+
+	//pixels from x (even) to the end of the pair, yRow1 is NULL for a last odd row
+	void pairScalar(const uint8_t* row0, const uint8_t* row1, uint8_t* yRow0, uint8_t* yRow1, uint8_t* uRow, uint8_t* vRow, int x, int width) const {
+		for (int i = x; i < width; i++) {
+			yRow0[i] = luma(row0 + i * 3);
+			if (yRow1) {
+				yRow1[i] = luma(row1 + i * 3);
+			}
+		}
+		for (; x < width; x += 2) {
+			int x1 = x + 1 < width ? x + 1 : x;
+			int r = row0[x * 3] + row0[x1 * 3] + row1[x * 3] + row1[x1 * 3];
+			int g = row0[x * 3 + 1] + row0[x1 * 3 + 1] + row1[x * 3 + 1] + row1[x1 * 3 + 1];
+			int b = row0[x * 3 + 2] + row0[x1 * 3 + 2] + row1[x * 3 + 2] + row1[x1 * 3 + 2];
+			uRow[x / 2] = chroma(uCoef, r, g, b, cOffset);
+			vRow[x / 2] = chroma(vCoef, r, g, b, cOffset);
+		}
+	}
+
+#ifdef SIMD_X86
+	//the loops below keep every pixel as 16 bit r, g, b, 0: pmaddwd with the
+	//coefficients (r, g, b, 0 too) and phaddd give one 32 bit sum per pixel, and
+	//adding the two rows before that the sums of the 2x2 blocks
+
+	//8 pixels a step, reading 4 bytes past them, returns where the scalar loop goes on
+	SIMD_TARGET("ssse3")
+	int pairSSSE3(const uint8_t* row0, const uint8_t* row1, uint8_t* yRow0, uint8_t* yRow1, uint8_t* uRow, uint8_t* vRow, int width) const {
+		const __m128i spread = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i yc = _mm_setr_epi16(yCoef[0], yCoef[1], yCoef[2], 0, yCoef[0], yCoef[1], yCoef[2], 0);
+		const __m128i uc = _mm_setr_epi16(uCoef[0], uCoef[1], uCoef[2], 0, uCoef[0], uCoef[1], uCoef[2], 0);
+		const __m128i vc = _mm_setr_epi16(vCoef[0], vCoef[1], vCoef[2], 0, vCoef[0], vCoef[1], vCoef[2], 0);
+		const __m128i yOff = _mm_set1_epi32(yOffset);
+		const __m128i cOff = _mm_set1_epi32(cOffset);
+		int x = 0;
+		for (; x + 10 <= width; x += 8) {
+			//pixels 0, 1 / 2, 3 / 4, 5 / 6, 7 of both rows
+			__m128i a0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(row0 + x * 3)), spread);
+			__m128i b0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(row0 + x * 3 + 12)), spread);
+			__m128i a1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(row1 + x * 3)), spread);
+			__m128i b1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(row1 + x * 3 + 12)), spread);
+			__m128i p0[4] = { _mm_unpacklo_epi8(a0, zero), _mm_unpackhi_epi8(a0, zero), _mm_unpacklo_epi8(b0, zero), _mm_unpackhi_epi8(b0, zero) };
+			__m128i p1[4] = { _mm_unpacklo_epi8(a1, zero), _mm_unpackhi_epi8(a1, zero), _mm_unpacklo_epi8(b1, zero), _mm_unpackhi_epi8(b1, zero) };
+
+			storeLumaSSSE3(p0, yc, yOff, yRow0 + x);
+			if (yRow1) {
+				storeLumaSSSE3(p1, yc, yOff, yRow1 + x);
+			}
+
+			__m128i sums[4];
+			for (int i = 0; i < 4; i++) {
+				sums[i] = _mm_add_epi16(p0[i], p1[i]);
+			}
+			__m128i u = chromaSSSE3(sums, uc, cOff);
+			__m128i v = chromaSSSE3(sums, vc, cOff);
+			__m128i uv = _mm_packus_epi16(_mm_packs_epi32(u, v), zero);
+			int uBytes = _mm_cvtsi128_si32(uv);
+			int vBytes = _mm_cvtsi128_si32(_mm_srli_si128(uv, 4));
+			memcpy(uRow + x / 2, &uBytes, 4);
+			memcpy(vRow + x / 2, &vBytes, 4);
+		}
+		return x;
+	}
+
+	SIMD_TARGET("ssse3")
+	static void storeLumaSSSE3(const __m128i* pixels, __m128i coef, __m128i offset, uint8_t* out) {
+		__m128i low = _mm_hadd_epi32(_mm_madd_epi16(pixels[0], coef), _mm_madd_epi16(pixels[1], coef));
+		__m128i high = _mm_hadd_epi32(_mm_madd_epi16(pixels[2], coef), _mm_madd_epi16(pixels[3], coef));
+		low = _mm_srai_epi32(_mm_add_epi32(low, offset), 15);
+		high = _mm_srai_epi32(_mm_add_epi32(high, offset), 15);
+		_mm_storel_epi64((__m128i*)out, _mm_packus_epi16(_mm_packs_epi32(low, high), _mm_setzero_si128()));
+	}
+
+	//the 4 chroma samples of 8 pixel sums, as 32 bit
+	SIMD_TARGET("ssse3")
+	static __m128i chromaSSSE3(const __m128i* sums, __m128i coef, __m128i offset) {
+		__m128i low = _mm_hadd_epi32(_mm_madd_epi16(sums[0], coef), _mm_madd_epi16(sums[1], coef));
+		__m128i high = _mm_hadd_epi32(_mm_madd_epi16(sums[2], coef), _mm_madd_epi16(sums[3], coef));
+		return _mm_srai_epi32(_mm_add_epi32(_mm_hadd_epi32(low, high), offset), 17);
+	}
+
+	//16 pixels a step, 4 per 128 bit load into alternating lanes, so the lanes
+	//hold pixels 0..3 | 4..7 and 8..11 | 12..15 and get put back in order at the end
+	SIMD_TARGET("avx2")
+	int pairAVX2(const uint8_t* row0, const uint8_t* row1, uint8_t* yRow0, uint8_t* yRow1, uint8_t* uRow, uint8_t* vRow, int width) const {
+		const __m256i spread = _mm256_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1,
+			0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+		const __m256i zero = _mm256_setzero_si256();
+		const __m256i yc = _mm256_setr_epi16(yCoef[0], yCoef[1], yCoef[2], 0, yCoef[0], yCoef[1], yCoef[2], 0,
+			yCoef[0], yCoef[1], yCoef[2], 0, yCoef[0], yCoef[1], yCoef[2], 0);
+		const __m256i uc = _mm256_setr_epi16(uCoef[0], uCoef[1], uCoef[2], 0, uCoef[0], uCoef[1], uCoef[2], 0,
+			uCoef[0], uCoef[1], uCoef[2], 0, uCoef[0], uCoef[1], uCoef[2], 0);
+		const __m256i vc = _mm256_setr_epi16(vCoef[0], vCoef[1], vCoef[2], 0, vCoef[0], vCoef[1], vCoef[2], 0,
+			vCoef[0], vCoef[1], vCoef[2], 0, vCoef[0], vCoef[1], vCoef[2], 0);
+		const __m256i yOff = _mm256_set1_epi32(yOffset);
+		const __m256i cOff = _mm256_set1_epi32(cOffset);
+		int x = 0;
+		for (; x + 18 <= width; x += 16) {
+			__m256i p0[4], p1[4];
+			loadPixelsAVX2(row0 + x * 3, spread, zero, p0);
+			loadPixelsAVX2(row1 + x * 3, spread, zero, p1);
+
+			storeLumaAVX2(p0, yc, yOff, yRow0 + x);
+			if (yRow1) {
+				storeLumaAVX2(p1, yc, yOff, yRow1 + x);
+			}
+
+			__m256i sums[4];
+			for (int i = 0; i < 4; i++) {
+				sums[i] = _mm256_add_epi16(p0[i], p1[i]);
+			}
+			//lanes hold samples 0, 1, 4, 5 | 2, 3, 6, 7, of u then v after the pack
+			__m256i uv = _mm256_packus_epi16(_mm256_packs_epi32(chromaAVX2(sums, uc, cOff), chromaAVX2(sums, vc, cOff)), zero);
+			__m128i ordered = _mm_unpacklo_epi16(_mm256_castsi256_si128(uv), _mm256_extracti128_si256(uv, 1));
+			_mm_storel_epi64((__m128i*)(uRow + x / 2), ordered);
+			_mm_storel_epi64((__m128i*)(vRow + x / 2), _mm_srli_si128(ordered, 8));
+		}
+		return x;
+	}
+
+	//16 pixels as 16 bit r, g, b, 0: 0, 1 | 4, 5  2, 3 | 6, 7  8, 9 | 12, 13  10, 11 | 14, 15
+	SIMD_TARGET("avx2")
+	static void loadPixelsAVX2(const uint8_t* rgb, __m256i spread, __m256i zero, __m256i* pixels) {
+		__m256i a = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)rgb)), _mm_loadu_si128((const __m128i*)(rgb + 12)), 1);
+		__m256i b = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)(rgb + 24))), _mm_loadu_si128((const __m128i*)(rgb + 36)), 1);
+		a = _mm256_shuffle_epi8(a, spread);
+		b = _mm256_shuffle_epi8(b, spread);
+		pixels[0] = _mm256_unpacklo_epi8(a, zero);
+		pixels[1] = _mm256_unpackhi_epi8(a, zero);
+		pixels[2] = _mm256_unpacklo_epi8(b, zero);
+		pixels[3] = _mm256_unpackhi_epi8(b, zero);
+	}
+
+	SIMD_TARGET("avx2")
+	static void storeLumaAVX2(const __m256i* pixels, __m256i coef, __m256i offset, uint8_t* out) {
+		//0..3 | 4..7 and 8..11 | 12..15
+		__m256i low = _mm256_hadd_epi32(_mm256_madd_epi16(pixels[0], coef), _mm256_madd_epi16(pixels[1], coef));
+		__m256i high = _mm256_hadd_epi32(_mm256_madd_epi16(pixels[2], coef), _mm256_madd_epi16(pixels[3], coef));
+		low = _mm256_srai_epi32(_mm256_add_epi32(low, offset), 15);
+		high = _mm256_srai_epi32(_mm256_add_epi32(high, offset), 15);
+		__m256i bytes = _mm256_packus_epi16(_mm256_packs_epi32(low, high), _mm256_setzero_si256());
+		//0..3, 8..11 | 4..7, 12..15
+		_mm_storeu_si128((__m128i*)out, _mm_unpacklo_epi32(_mm256_castsi256_si128(bytes), _mm256_extracti128_si256(bytes, 1)));
+	}
+
+	SIMD_TARGET("avx2")
+	static __m256i chromaAVX2(const __m256i* sums, __m256i coef, __m256i offset) {
+		__m256i low = _mm256_hadd_epi32(_mm256_madd_epi16(sums[0], coef), _mm256_madd_epi16(sums[1], coef));
+		__m256i high = _mm256_hadd_epi32(_mm256_madd_epi16(sums[2], coef), _mm256_madd_epi16(sums[3], coef));
+		return _mm256_srai_epi32(_mm256_add_epi32(_mm256_hadd_epi32(low, high), offset), 17);
+	}
+#endif
+};